@@ -0,0 +1,17 @@
+// Stand-in for the Azure IoT C SDK, only covering what cpputils uses.
+#ifndef IOTHUB_H
+#define IOTHUB_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  int IoTHub_Init(void);
+  void IoTHub_Deinit(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTHUB_H
@@ -0,0 +1,28 @@
+// Stand-in for the Azure IoT C SDK, only covering what cpputils uses.
+#ifndef IOTHUB_CLIENT_H
+#define IOTHUB_CLIENT_H
+
+#include "iothub_device_client.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  // The mock serves both client flavours from the same instance
+  typedef IOTHUB_CLIENT_CORE_HANDLE IOTHUB_CLIENT_HANDLE;
+
+  IOTHUB_CLIENT_RESULT IoTHubClient_SetRetryPolicy(
+      IOTHUB_CLIENT_HANDLE iotHubClientHandle,
+      IOTHUB_CLIENT_RETRY_POLICY retryPolicy, size_t retryTimeoutLimitInSeconds);
+  IOTHUB_CLIENT_RESULT IoTHubClient_UploadToBlobAsync(
+      IOTHUB_CLIENT_HANDLE iotHubClientHandle, const char *destinationFileName,
+      const unsigned char *source, size_t size,
+      IOTHUB_CLIENT_FILE_UPLOAD_CALLBACK iotHubClientFileUploadCallback,
+      void *context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTHUB_CLIENT_H
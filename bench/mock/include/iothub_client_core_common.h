@@ -0,0 +1,89 @@
+// Stand-in for the Azure IoT C SDK, only covering what cpputils uses.
+#ifndef IOTHUB_CLIENT_CORE_COMMON_H
+#define IOTHUB_CLIENT_CORE_COMMON_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  typedef enum IOTHUB_CLIENT_RESULT_TAG
+  {
+    IOTHUB_CLIENT_OK,
+    IOTHUB_CLIENT_INVALID_ARG,
+    IOTHUB_CLIENT_ERROR,
+    IOTHUB_CLIENT_INVALID_SIZE,
+    IOTHUB_CLIENT_INDEFINITE_TIME
+  } IOTHUB_CLIENT_RESULT;
+
+  typedef enum IOTHUB_CLIENT_CONFIRMATION_RESULT_TAG
+  {
+    IOTHUB_CLIENT_CONFIRMATION_OK,
+    IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY,
+    IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT,
+    IOTHUB_CLIENT_CONFIRMATION_ERROR
+  } IOTHUB_CLIENT_CONFIRMATION_RESULT;
+
+  typedef enum IOTHUB_CLIENT_CONNECTION_STATUS_TAG
+  {
+    IOTHUB_CLIENT_CONNECTION_AUTHENTICATED,
+    IOTHUB_CLIENT_CONNECTION_UNAUTHENTICATED
+  } IOTHUB_CLIENT_CONNECTION_STATUS;
+
+  typedef enum IOTHUB_CLIENT_CONNECTION_STATUS_REASON_TAG
+  {
+    IOTHUB_CLIENT_CONNECTION_EXPIRED_SAS_TOKEN,
+    IOTHUB_CLIENT_CONNECTION_DEVICE_DISABLED,
+    IOTHUB_CLIENT_CONNECTION_BAD_CREDENTIAL,
+    IOTHUB_CLIENT_CONNECTION_RETRY_EXPIRED,
+    IOTHUB_CLIENT_CONNECTION_NO_NETWORK,
+    IOTHUB_CLIENT_CONNECTION_COMMUNICATION_ERROR,
+    IOTHUB_CLIENT_CONNECTION_OK
+  } IOTHUB_CLIENT_CONNECTION_STATUS_REASON;
+
+  typedef enum IOTHUB_CLIENT_RETRY_POLICY_TAG
+  {
+    IOTHUB_CLIENT_RETRY_NONE,
+    IOTHUB_CLIENT_RETRY_IMMEDIATE,
+    IOTHUB_CLIENT_RETRY_INTERVAL,
+    IOTHUB_CLIENT_RETRY_LINEAR_BACKOFF,
+    IOTHUB_CLIENT_RETRY_EXPONENTIAL_BACKOFF,
+    IOTHUB_CLIENT_RETRY_EXPONENTIAL_BACKOFF_WITH_JITTER,
+    IOTHUB_CLIENT_RETRY_RANDOM
+  } IOTHUB_CLIENT_RETRY_POLICY;
+
+  typedef enum DEVICE_TWIN_UPDATE_STATE_TAG
+  {
+    DEVICE_TWIN_UPDATE_COMPLETE,
+    DEVICE_TWIN_UPDATE_PARTIAL
+  } DEVICE_TWIN_UPDATE_STATE;
+
+  typedef enum IOTHUB_CLIENT_FILE_UPLOAD_RESULT_TAG
+  {
+    FILE_UPLOAD_OK,
+    FILE_UPLOAD_ERROR
+  } IOTHUB_CLIENT_FILE_UPLOAD_RESULT;
+
+  typedef struct TRANSPORT_PROVIDER_TAG TRANSPORT_PROVIDER;
+  typedef const TRANSPORT_PROVIDER *(*IOTHUB_CLIENT_TRANSPORT_PROVIDER)(void);
+
+  typedef void (*IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK)(
+      IOTHUB_CLIENT_CONFIRMATION_RESULT result, void *userContextCallback);
+  typedef void (*IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK)(
+      IOTHUB_CLIENT_CONNECTION_STATUS result,
+      IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason, void *userContextCallback);
+  typedef void (*IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK)(
+      DEVICE_TWIN_UPDATE_STATE update_state, const unsigned char *payLoad,
+      size_t size, void *userContextCallback);
+  typedef void (*IOTHUB_CLIENT_REPORTED_STATE_CALLBACK)(
+      int status_code, void *userContextCallback);
+  typedef void (*IOTHUB_CLIENT_FILE_UPLOAD_CALLBACK)(
+      IOTHUB_CLIENT_FILE_UPLOAD_RESULT result, void *userContextCallback);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTHUB_CLIENT_CORE_COMMON_H
@@ -0,0 +1,8 @@
+// Stand-in for the Azure IoT C SDK, only covering what cpputils uses.
+#ifndef IOTHUB_CLIENT_OPTIONS_H
+#define IOTHUB_CLIENT_OPTIONS_H
+
+#define OPTION_LOG_TRACE "logtrace"
+#define OPTION_EVENT_SEND_TIMEOUT_SECS "event_send_timeout_secs"
+
+#endif // IOTHUB_CLIENT_OPTIONS_H
@@ -0,0 +1,47 @@
+// Stand-in for the Azure IoT C SDK, only covering what cpputils uses.
+#ifndef IOTHUB_DEVICE_CLIENT_H
+#define IOTHUB_DEVICE_CLIENT_H
+
+#include "iothub_client_core_common.h"
+#include "iothub_message.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  typedef struct IOTHUB_CLIENT_CORE_INSTANCE_TAG *IOTHUB_CLIENT_CORE_HANDLE;
+  typedef IOTHUB_CLIENT_CORE_HANDLE IOTHUB_DEVICE_CLIENT_HANDLE;
+
+  IOTHUB_DEVICE_CLIENT_HANDLE IoTHubDeviceClient_CreateFromConnectionString(
+      const char *connectionString, IOTHUB_CLIENT_TRANSPORT_PROVIDER protocol);
+  void IoTHubDeviceClient_Destroy(IOTHUB_DEVICE_CLIENT_HANDLE iotHubClientHandle);
+
+  IOTHUB_CLIENT_RESULT IoTHubDeviceClient_SendEventAsync(
+      IOTHUB_DEVICE_CLIENT_HANDLE iotHubClientHandle,
+      IOTHUB_MESSAGE_HANDLE eventMessageHandle,
+      IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback,
+      void *userContextCallback);
+  IOTHUB_CLIENT_RESULT IoTHubDeviceClient_SetConnectionStatusCallback(
+      IOTHUB_DEVICE_CLIENT_HANDLE iotHubClientHandle,
+      IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK connectionStatusCallback,
+      void *userContextCallback);
+  IOTHUB_CLIENT_RESULT IoTHubDeviceClient_SetDeviceTwinCallback(
+      IOTHUB_DEVICE_CLIENT_HANDLE iotHubClientHandle,
+      IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK deviceTwinCallback,
+      void *userContextCallback);
+  IOTHUB_CLIENT_RESULT IoTHubDeviceClient_GetTwinAsync(
+      IOTHUB_DEVICE_CLIENT_HANDLE iotHubClientHandle,
+      IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK deviceTwinCallback,
+      void *userContextCallback);
+  IOTHUB_CLIENT_RESULT IoTHubDeviceClient_SendReportedState(
+      IOTHUB_DEVICE_CLIENT_HANDLE iotHubClientHandle,
+      const unsigned char *reportedState, size_t size,
+      IOTHUB_CLIENT_REPORTED_STATE_CALLBACK reportedStateCallback,
+      void *userContextCallback);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTHUB_DEVICE_CLIENT_H
@@ -0,0 +1,34 @@
+// Stand-in for the Azure IoT C SDK, only covering what cpputils uses.
+#ifndef IOTHUB_MESSAGE_H
+#define IOTHUB_MESSAGE_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  typedef enum IOTHUB_MESSAGE_RESULT_TAG
+  {
+    IOTHUB_MESSAGE_OK,
+    IOTHUB_MESSAGE_INVALID_ARG,
+    IOTHUB_MESSAGE_INVALID_TYPE,
+    IOTHUB_MESSAGE_ERROR
+  } IOTHUB_MESSAGE_RESULT;
+
+  typedef struct IOTHUB_MESSAGE_HANDLE_DATA_TAG *IOTHUB_MESSAGE_HANDLE;
+
+  IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromString(const char *source);
+  void IoTHubMessage_Destroy(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle);
+  IOTHUB_MESSAGE_RESULT IoTHubMessage_SetContentTypeSystemProperty(
+      IOTHUB_MESSAGE_HANDLE iotHubMessageHandle, const char *contentType);
+  IOTHUB_MESSAGE_RESULT IoTHubMessage_SetContentEncodingSystemProperty(
+      IOTHUB_MESSAGE_HANDLE iotHubMessageHandle, const char *contentEncoding);
+  IOTHUB_MESSAGE_RESULT IoTHubMessage_SetProperty(
+      IOTHUB_MESSAGE_HANDLE iotHubMessageHandle, const char *key,
+      const char *value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTHUB_MESSAGE_H
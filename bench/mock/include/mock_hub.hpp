@@ -0,0 +1,56 @@
+#ifndef MOCK_HUB_HPP
+#define MOCK_HUB_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Local stand-in for IoT Hub. Every client created through the mock SDK
+// gets a worker thread, like the SDK convenience layer, which answers
+// telemetry, twin and upload requests after the configured latency.
+namespace mock_hub
+{
+  struct Config
+  {
+    // Round trip between the device and the hub
+    std::chrono::microseconds latency{20000};
+    // Share of messages, reports and uploads answered with an error
+    double failure_rate = 0.0;
+    // Keep the payload of every reported state update for Collect
+    bool record_reports = false;
+  };
+
+  struct Stats
+  {
+    std::uint64_t clients = 0;
+    std::uint64_t messages = 0;
+    std::uint64_t confirmations = 0;
+    // Messages confirmed with IOTHUB_CLIENT_CONFIRMATION_ERROR
+    std::uint64_t message_errors = 0;
+    std::uint64_t reports = 0;
+    std::uint64_t twin_requests = 0;
+    std::uint64_t desired_updates = 0;
+    std::uint64_t uploads = 0;
+    std::uint64_t bytes = 0;
+    // From IoTHubDeviceClient_SendEventAsync until the confirmation
+    // callback returned, in nanoseconds
+    std::vector<std::uint64_t> confirmation_latencies;
+    // Reported state payloads in the order they were sent, from clients
+    // created with Config::record_reports
+    std::vector<std::string> reported_states;
+  };
+
+  void Configure(const Config &config);
+
+  // Sends a partial desired properties update to every live client
+  void UpdateDesired(const std::string &patch);
+
+  // Answers the next count reported state updates with 500, whatever the
+  // failure rate
+  void FailReports(unsigned count);
+
+  Stats Collect();
+} // namespace mock_hub
+
+#endif
@@ -0,0 +1,524 @@
+#include <mock_hub.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <random>
+#include <set>
+#include <thread>
+
+#include <iothub.h>
+#include <iothub_client.h>
+#include <iothub_device_client.h>
+#include <iothub_message.h>
+#include <iothubtransportmqtt.h>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+using clock_type = std::chrono::steady_clock;
+
+struct TRANSPORT_PROVIDER_TAG
+{
+  int unused;
+};
+
+struct IOTHUB_MESSAGE_HANDLE_DATA_TAG
+{
+  std::string body;
+  std::string content_type;
+  std::string content_encoding;
+  std::map<std::string, std::string> properties;
+};
+
+struct IOTHUB_CLIENT_CORE_INSTANCE_TAG
+{
+  // Called with true when the client is being destroyed before it was due
+  using Task = std::function<void(bool)>;
+
+  mock_hub::Config config;
+  std::multimap<clock_type::time_point, Task> tasks;
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool stop = false;
+  std::thread worker;
+
+  // Only touched from the worker thread
+  IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK twin_callback = nullptr;
+  void *twin_context = nullptr;
+  json desired = {{"$version", 1}};
+  json reported = json::object();
+  std::minstd_rand random{std::random_device{}()};
+};
+
+namespace
+{
+  using Client = IOTHUB_CLIENT_CORE_INSTANCE_TAG;
+
+  std::mutex hub_mutex;
+  mock_hub::Config hub_config;
+  std::set<Client *> clients;
+
+  std::atomic<std::uint64_t> client_count{0};
+  std::atomic<std::uint64_t> message_count{0};
+  std::atomic<std::uint64_t> confirmation_count{0};
+  std::atomic<std::uint64_t> message_error_count{0};
+  std::atomic<std::uint64_t> report_count{0};
+  std::atomic<std::uint64_t> twin_request_count{0};
+  std::atomic<std::uint64_t> desired_update_count{0};
+  std::atomic<std::uint64_t> upload_count{0};
+  std::atomic<std::uint64_t> byte_count{0};
+  std::atomic<unsigned> failing_reports{0};
+
+  std::mutex latencies_mutex;
+  std::vector<std::uint64_t> latencies;
+
+  std::mutex reports_mutex;
+  std::vector<std::string> reported_states;
+
+  void Work(Client *client)
+  {
+    std::unique_lock<std::mutex> lock(client->mutex);
+    while (true)
+    {
+      if (client->tasks.empty())
+      {
+        if (client->stop)
+        {
+          break;
+        }
+        client->cv.wait(lock);
+        continue;
+      }
+
+      auto first = client->tasks.begin();
+      if (!client->stop && first->first > clock_type::now())
+      {
+        client->cv.wait_until(lock, first->first);
+        continue;
+      }
+
+      Client::Task task = std::move(first->second);
+      bool destroying = client->stop;
+      client->tasks.erase(first);
+
+      lock.unlock();
+      task(destroying);
+      lock.lock();
+    }
+  }
+
+  // Runs task on the client thread once the hub latency has elapsed
+  void Schedule(Client *client, Client::Task task)
+  {
+    {
+      std::lock_guard<std::mutex> guard(client->mutex);
+      client->tasks.emplace(clock_type::now() + client->config.latency,
+                            std::move(task));
+    }
+    client->cv.notify_one();
+  }
+
+  // Only called from the worker thread
+  bool ShouldFail(Client *client)
+  {
+    if (client->config.failure_rate <= 0.0)
+    {
+      return false;
+    }
+    std::uniform_real_distribution<double> distribution(0.0, 1.0);
+    return distribution(client->random) < client->config.failure_rate;
+  }
+
+  std::string TwinDocument(Client *client)
+  {
+    return json{{"desired", client->desired}, {"reported", client->reported}}
+        .dump();
+  }
+
+  void SendTwin(Client *client, IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK callback,
+                void *context)
+  {
+    std::string twin = TwinDocument(client);
+    callback(DEVICE_TWIN_UPDATE_COMPLETE,
+             reinterpret_cast<const unsigned char *>(twin.data()), twin.size(),
+             context);
+  }
+} // namespace
+
+namespace mock_hub
+{
+  void Configure(const Config &config)
+  {
+    std::lock_guard<std::mutex> guard(hub_mutex);
+    hub_config = config;
+  }
+
+  void UpdateDesired(const std::string &patch)
+  {
+    json desired_patch = json::parse(patch);
+
+    std::lock_guard<std::mutex> guard(hub_mutex);
+    for (Client *client : clients)
+    {
+      Schedule(client, [client, desired_patch](bool destroying) mutable {
+        if (destroying)
+        {
+          return;
+        }
+
+        client->desired.merge_patch(desired_patch);
+        client->desired["$version"] = client->desired["$version"].get<int>() + 1;
+        desired_update_count++;
+
+        if (client->twin_callback != nullptr)
+        {
+          desired_patch["$version"] = client->desired["$version"];
+          std::string body = desired_patch.dump();
+          client->twin_callback(
+              DEVICE_TWIN_UPDATE_PARTIAL,
+              reinterpret_cast<const unsigned char *>(body.data()), body.size(),
+              client->twin_context);
+        }
+      });
+    }
+  }
+
+  void FailReports(unsigned count)
+  {
+    failing_reports = count;
+  }
+
+  Stats Collect()
+  {
+    Stats stats;
+    stats.clients = client_count;
+    stats.messages = message_count;
+    stats.confirmations = confirmation_count;
+    stats.message_errors = message_error_count;
+    stats.reports = report_count;
+    stats.twin_requests = twin_request_count;
+    stats.desired_updates = desired_update_count;
+    stats.uploads = upload_count;
+    stats.bytes = byte_count;
+
+    {
+      std::lock_guard<std::mutex> guard(latencies_mutex);
+      stats.confirmation_latencies = latencies;
+    }
+    {
+      std::lock_guard<std::mutex> guard(reports_mutex);
+      stats.reported_states = reported_states;
+    }
+    return stats;
+  }
+} // namespace mock_hub
+
+int IoTHub_Init(void)
+{
+  return 0;
+}
+
+void IoTHub_Deinit(void) {}
+
+const TRANSPORT_PROVIDER *MQTT_Protocol(void)
+{
+  static TRANSPORT_PROVIDER provider{};
+  return &provider;
+}
+
+IOTHUB_DEVICE_CLIENT_HANDLE IoTHubDeviceClient_CreateFromConnectionString(
+    const char *connectionString, IOTHUB_CLIENT_TRANSPORT_PROVIDER protocol)
+{
+  if (connectionString == nullptr || protocol == nullptr)
+  {
+    return nullptr;
+  }
+
+  Client *client = new Client();
+  std::lock_guard<std::mutex> guard(hub_mutex);
+  client->config = hub_config;
+  client->worker = std::thread(Work, client);
+  clients.insert(client);
+  client_count++;
+
+  return client;
+}
+
+void IoTHubDeviceClient_Destroy(IOTHUB_DEVICE_CLIENT_HANDLE iotHubClientHandle)
+{
+  if (iotHubClientHandle == nullptr)
+  {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(hub_mutex);
+    clients.erase(iotHubClientHandle);
+  }
+  {
+    std::lock_guard<std::mutex> guard(iotHubClientHandle->mutex);
+    iotHubClientHandle->stop = true;
+  }
+  iotHubClientHandle->cv.notify_one();
+  iotHubClientHandle->worker.join();
+
+  delete iotHubClientHandle;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClient_SetRetryPolicy(
+    IOTHUB_CLIENT_HANDLE iotHubClientHandle, IOTHUB_CLIENT_RETRY_POLICY,
+    size_t)
+{
+  return iotHubClientHandle == nullptr ? IOTHUB_CLIENT_INVALID_ARG
+                                       : IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_SetConnectionStatusCallback(
+    IOTHUB_DEVICE_CLIENT_HANDLE iotHubClientHandle,
+    IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK connectionStatusCallback,
+    void *userContextCallback)
+{
+  if (iotHubClientHandle == nullptr)
+  {
+    return IOTHUB_CLIENT_INVALID_ARG;
+  }
+
+  Schedule(iotHubClientHandle, [=](bool destroying) {
+    if (!destroying && connectionStatusCallback != nullptr)
+    {
+      connectionStatusCallback(IOTHUB_CLIENT_CONNECTION_AUTHENTICATED,
+                               IOTHUB_CLIENT_CONNECTION_OK, userContextCallback);
+    }
+  });
+
+  return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_SetDeviceTwinCallback(
+    IOTHUB_DEVICE_CLIENT_HANDLE iotHubClientHandle,
+    IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK deviceTwinCallback,
+    void *userContextCallback)
+{
+  if (iotHubClientHandle == nullptr)
+  {
+    return IOTHUB_CLIENT_INVALID_ARG;
+  }
+
+  // Like the real hub, subscribing sends the whole twin first
+  Client *client = iotHubClientHandle;
+  Schedule(client, [=](bool destroying) {
+    client->twin_callback = deviceTwinCallback;
+    client->twin_context = userContextCallback;
+    if (!destroying && deviceTwinCallback != nullptr)
+    {
+      SendTwin(client, deviceTwinCallback, userContextCallback);
+    }
+  });
+
+  return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_GetTwinAsync(
+    IOTHUB_DEVICE_CLIENT_HANDLE iotHubClientHandle,
+    IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK deviceTwinCallback,
+    void *userContextCallback)
+{
+  if (iotHubClientHandle == nullptr || deviceTwinCallback == nullptr)
+  {
+    return IOTHUB_CLIENT_INVALID_ARG;
+  }
+
+  twin_request_count++;
+  Client *client = iotHubClientHandle;
+  Schedule(client, [=](bool destroying) {
+    if (!destroying)
+    {
+      SendTwin(client, deviceTwinCallback, userContextCallback);
+    }
+  });
+
+  return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_SendReportedState(
+    IOTHUB_DEVICE_CLIENT_HANDLE iotHubClientHandle,
+    const unsigned char *reportedState, size_t size,
+    IOTHUB_CLIENT_REPORTED_STATE_CALLBACK reportedStateCallback,
+    void *userContextCallback)
+{
+  if (iotHubClientHandle == nullptr || reportedState == nullptr || size == 0)
+  {
+    return IOTHUB_CLIENT_INVALID_ARG;
+  }
+
+  report_count++;
+  byte_count += size;
+  Client *client = iotHubClientHandle;
+  std::string patch(reinterpret_cast<const char *>(reportedState), size);
+  if (client->config.record_reports)
+  {
+    std::lock_guard<std::mutex> guard(reports_mutex);
+    reported_states.push_back(patch);
+  }
+
+  // Taken now rather than when answering, so it hits this very report
+  unsigned failing = failing_reports;
+  while (failing > 0 &&
+         !failing_reports.compare_exchange_weak(failing, failing - 1))
+  {
+  }
+  bool forced = failing > 0;
+
+  Schedule(client, [=](bool destroying) {
+    if (destroying)
+    {
+      return;
+    }
+
+    bool failed = forced || ShouldFail(client);
+    if (!failed)
+    {
+      client->reported.merge_patch(json::parse(patch));
+    }
+    if (reportedStateCallback != nullptr)
+    {
+      reportedStateCallback(failed ? 500 : 204, userContextCallback);
+    }
+  });
+
+  return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_SendEventAsync(
+    IOTHUB_DEVICE_CLIENT_HANDLE iotHubClientHandle,
+    IOTHUB_MESSAGE_HANDLE eventMessageHandle,
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback,
+    void *userContextCallback)
+{
+  if (iotHubClientHandle == nullptr || eventMessageHandle == nullptr)
+  {
+    return IOTHUB_CLIENT_INVALID_ARG;
+  }
+
+  message_count++;
+  byte_count += eventMessageHandle->body.size();
+  Client *client = iotHubClientHandle;
+  auto sent_at = clock_type::now();
+  // The SDK owns a clone of the message until it is confirmed
+  auto message =
+      std::make_shared<IOTHUB_MESSAGE_HANDLE_DATA_TAG>(*eventMessageHandle);
+  Schedule(client, [=](bool destroying) {
+    IOTHUB_CLIENT_CONFIRMATION_RESULT result = IOTHUB_CLIENT_CONFIRMATION_OK;
+    if (destroying)
+    {
+      result = IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY;
+    }
+    else if (ShouldFail(client))
+    {
+      result = IOTHUB_CLIENT_CONFIRMATION_ERROR;
+    }
+
+    if (eventConfirmationCallback != nullptr)
+    {
+      eventConfirmationCallback(result, userContextCallback);
+    }
+
+    if (result == IOTHUB_CLIENT_CONFIRMATION_ERROR)
+    {
+      message_error_count++;
+    }
+    else if (result == IOTHUB_CLIENT_CONFIRMATION_OK)
+    {
+      auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(
+          clock_type::now() - sent_at);
+      confirmation_count++;
+
+      std::lock_guard<std::mutex> guard(latencies_mutex);
+      latencies.push_back(latency.count());
+    }
+  });
+
+  return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClient_UploadToBlobAsync(
+    IOTHUB_CLIENT_HANDLE iotHubClientHandle, const char *destinationFileName,
+    const unsigned char *source, size_t size,
+    IOTHUB_CLIENT_FILE_UPLOAD_CALLBACK iotHubClientFileUploadCallback,
+    void *context)
+{
+  if (iotHubClientHandle == nullptr || destinationFileName == nullptr ||
+      (source == nullptr && size > 0))
+  {
+    return IOTHUB_CLIENT_INVALID_ARG;
+  }
+
+  upload_count++;
+  byte_count += size;
+  Client *client = iotHubClientHandle;
+  Schedule(client, [=](bool destroying) {
+    if (!destroying && iotHubClientFileUploadCallback != nullptr)
+    {
+      iotHubClientFileUploadCallback(
+          ShouldFail(client) ? FILE_UPLOAD_ERROR : FILE_UPLOAD_OK, context);
+    }
+  });
+
+  return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromString(const char *source)
+{
+  if (source == nullptr)
+  {
+    return nullptr;
+  }
+
+  IOTHUB_MESSAGE_HANDLE message = new IOTHUB_MESSAGE_HANDLE_DATA_TAG();
+  message->body = source;
+  return message;
+}
+
+void IoTHubMessage_Destroy(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
+{
+  delete iotHubMessageHandle;
+}
+
+IOTHUB_MESSAGE_RESULT IoTHubMessage_SetContentTypeSystemProperty(
+    IOTHUB_MESSAGE_HANDLE iotHubMessageHandle, const char *contentType)
+{
+  if (iotHubMessageHandle == nullptr || contentType == nullptr)
+  {
+    return IOTHUB_MESSAGE_INVALID_ARG;
+  }
+
+  iotHubMessageHandle->content_type = contentType;
+  return IOTHUB_MESSAGE_OK;
+}
+
+IOTHUB_MESSAGE_RESULT IoTHubMessage_SetContentEncodingSystemProperty(
+    IOTHUB_MESSAGE_HANDLE iotHubMessageHandle, const char *contentEncoding)
+{
+  if (iotHubMessageHandle == nullptr || contentEncoding == nullptr)
+  {
+    return IOTHUB_MESSAGE_INVALID_ARG;
+  }
+
+  iotHubMessageHandle->content_encoding = contentEncoding;
+  return IOTHUB_MESSAGE_OK;
+}
+
+IOTHUB_MESSAGE_RESULT IoTHubMessage_SetProperty(
+    IOTHUB_MESSAGE_HANDLE iotHubMessageHandle, const char *key,
+    const char *value)
+{
+  if (iotHubMessageHandle == nullptr || key == nullptr || value == nullptr)
+  {
+    return IOTHUB_MESSAGE_INVALID_ARG;
+  }
+
+  iotHubMessageHandle->properties[key] = value;
+  return IOTHUB_MESSAGE_OK;
+}
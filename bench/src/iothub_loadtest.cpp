@@ -0,0 +1,416 @@
+// Simulates N devices sending M messages/s each through IoTHubConnection,
+// against the local hub stand-in, and prints the results as JSON.
+//
+//   iothub_loadtest --devices 100 --rate 10 --seconds 30 --latency-ms 20
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <iothub/iot_hub_connection.hpp>
+#include <mock_hub.hpp>
+
+namespace
+{
+  struct LoadState
+  {
+    int sequence = 0;
+    double temperature = 0.0;
+    int fan_speed = 0;
+    bool enabled = false;
+    std::string mode = "auto";
+  };
+} // namespace
+
+IOTHUB_REFLECT(LoadState, sequence, temperature, fan_speed, enabled, mode)
+
+namespace
+{
+  using Connection = iothub::IoTHubConnection<LoadState>;
+  using clock_type = std::chrono::steady_clock;
+
+  struct Options
+  {
+    std::size_t devices = 10;
+    double rate = 10.0;
+    double seconds = 10.0;
+    std::size_t payload = 256;
+    long latency_ms = 20;
+    double failure_rate = 0.0;
+    // Reported state updates per message sent, 0 disables them
+    std::size_t report_every = 1;
+    bool delta = false;
+    long debounce_ms = 0;
+    double desired_rate = 0.0;
+    std::string executor = "inline";
+    std::size_t pool_threads = 4;
+    std::size_t drivers = 0;
+  };
+
+  struct ProcessStatus
+  {
+    long rss_kb = 0;
+    long peak_rss_kb = 0;
+    long threads = 0;
+  };
+
+  ProcessStatus ReadProcessStatus()
+  {
+    ProcessStatus status;
+    std::ifstream file("/proc/self/status");
+    std::string key;
+    while (file >> key)
+    {
+      if (key == "VmRSS:")
+      {
+        file >> status.rss_kb;
+      }
+      else if (key == "VmHWM:")
+      {
+        file >> status.peak_rss_kb;
+      }
+      else if (key == "Threads:")
+      {
+        file >> status.threads;
+      }
+      file.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    }
+    return status;
+  }
+
+  [[noreturn]] void Usage(const char *program)
+  {
+    std::cerr
+        << "Usage: " << program << " [options]\n"
+        << "  --devices N         simulated devices (10)\n"
+        << "  --rate M            messages per second per device (10)\n"
+        << "  --seconds S         test duration (10)\n"
+        << "  --payload B         message size in bytes (256)\n"
+        << "  --latency-ms L      hub round trip (20)\n"
+        << "  --failure-rate F    share of requests failed by the hub (0)\n"
+        << "  --report-every K    reported state update every K messages (1)\n"
+        << "  --delta             send reported state as merge-patches\n"
+        << "  --debounce-ms D     coalesce reported state updates (0)\n"
+        << "  --desired-rate R    desired property updates per second (0)\n"
+        << "  --executor E        inline, thread or pool (inline)\n"
+        << "  --pool-threads T    workers of the pool executor (4)\n"
+        << "  --drivers D         threads sending messages (devices, max 8)\n";
+    std::exit(EXIT_FAILURE);
+  }
+
+  Options ParseOptions(int argc, char **argv)
+  {
+    Options options;
+    for (int i = 1; i < argc; i++)
+    {
+      std::string arg = argv[i];
+      auto value = [&]() -> std::string {
+        if (i + 1 >= argc)
+        {
+          Usage(argv[0]);
+        }
+        return argv[++i];
+      };
+
+      if (arg == "--devices")
+        options.devices = std::stoul(value());
+      else if (arg == "--rate")
+        options.rate = std::stod(value());
+      else if (arg == "--seconds")
+        options.seconds = std::stod(value());
+      else if (arg == "--payload")
+        options.payload = std::stoul(value());
+      else if (arg == "--latency-ms")
+        options.latency_ms = std::stol(value());
+      else if (arg == "--failure-rate")
+        options.failure_rate = std::stod(value());
+      else if (arg == "--report-every")
+        options.report_every = std::stoul(value());
+      else if (arg == "--delta")
+        options.delta = true;
+      else if (arg == "--debounce-ms")
+        options.debounce_ms = std::stol(value());
+      else if (arg == "--desired-rate")
+        options.desired_rate = std::stod(value());
+      else if (arg == "--executor")
+        options.executor = value();
+      else if (arg == "--pool-threads")
+        options.pool_threads = std::stoul(value());
+      else if (arg == "--drivers")
+        options.drivers = std::stoul(value());
+      else
+        Usage(argv[0]);
+    }
+
+    if (options.devices == 0 || options.rate <= 0.0 || options.seconds <= 0.0 ||
+        (options.executor != "inline" && options.executor != "thread" &&
+         options.executor != "pool"))
+    {
+      Usage(argv[0]);
+    }
+    if (options.drivers == 0)
+    {
+      options.drivers = std::min<std::size_t>(options.devices, 8);
+    }
+
+    return options;
+  }
+
+  json Percentiles(std::vector<std::uint64_t> samples)
+  {
+    json result = json::object();
+    if (samples.empty())
+    {
+      return result;
+    }
+
+    std::sort(samples.begin(), samples.end());
+    auto at = [&](double p) {
+      std::size_t index = static_cast<std::size_t>(p * (samples.size() - 1));
+      return samples[index] / 1000.0;
+    };
+
+    result["p50_us"] = at(0.50);
+    result["p90_us"] = at(0.90);
+    result["p99_us"] = at(0.99);
+    result["p999_us"] = at(0.999);
+    result["max_us"] = samples.back() / 1000.0;
+    return result;
+  }
+
+  struct Device
+  {
+    std::unique_ptr<Connection> connection;
+    LoadState state;
+    std::size_t sent = 0;
+  };
+} // namespace
+
+int main(int argc, char **argv)
+{
+  Options options = ParseOptions(argc, argv);
+
+  mock_hub::Config config;
+  config.latency = std::chrono::milliseconds(options.latency_ms);
+  config.failure_rate = options.failure_rate;
+  mock_hub::Configure(config);
+
+  ProcessStatus baseline = ReadProcessStatus();
+
+  std::unique_ptr<iothub::ThreadPoolExecutor> pool;
+  if (options.executor == "pool")
+  {
+    pool = std::make_unique<iothub::ThreadPoolExecutor>(options.pool_threads);
+  }
+
+  std::atomic<std::uint64_t> errors{0};
+  std::atomic<std::uint64_t> state_changes{0};
+  std::atomic<std::uint64_t> send_failures{0};
+
+  std::vector<Device> devices(options.devices);
+  for (std::size_t i = 0; i < devices.size(); i++)
+  {
+    std::string connection_string = "HostName=localhost;DeviceId=device-" +
+                                    std::to_string(i) + ";SharedAccessKey=mock";
+    devices[i].connection = std::make_unique<Connection>(connection_string);
+
+    if (options.executor == "thread")
+    {
+      devices[i].connection->SetCallbackExecutor(
+          std::make_shared<iothub::ThreadExecutor>());
+    }
+    else if (pool)
+    {
+      devices[i].connection->SetCallbackExecutor(pool->MakeStrand());
+    }
+
+    devices[i].connection->SetReportMode(
+        options.delta ? Connection::ReportMode::Delta
+                      : Connection::ReportMode::Full,
+        std::chrono::milliseconds(options.debounce_ms));
+    devices[i].connection->OnError([&errors]() { errors++; });
+    devices[i].connection->OnStateChange(
+        [&state_changes](LoadState) { state_changes++; });
+    devices[i].connection->OnConnectionStateChange(
+        [](IOTHUB_CLIENT_CONNECTION_STATUS, IOTHUB_CLIENT_CONNECTION_STATUS_REASON) {});
+  }
+
+  const std::string payload =
+      "{\"data\":\"" + std::string(options.payload > 11 ? options.payload - 11 : 0, 'x') + "\"}";
+  const Connection::Properties props{{"source", "loadtest"}};
+  const auto period =
+      std::chrono::duration_cast<clock_type::duration>(
+          std::chrono::duration<double>(1.0 / options.rate));
+  const auto start = clock_type::now();
+  const auto end = start + std::chrono::duration_cast<clock_type::duration>(
+                               std::chrono::duration<double>(options.seconds));
+
+  // The kernel tracks the peak RSS (VmHWM), only threads need sampling
+  std::atomic<bool> running{true};
+  ProcessStatus peak = baseline;
+  std::thread sampler([&]() {
+    while (running)
+    {
+      ProcessStatus status = ReadProcessStatus();
+      peak.threads = std::max(peak.threads, status.threads);
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+  });
+
+  std::thread desired;
+  if (options.desired_rate > 0.0)
+  {
+    desired = std::thread([&]() {
+      auto desired_period = std::chrono::duration_cast<clock_type::duration>(
+          std::chrono::duration<double>(1.0 / options.desired_rate));
+      int fan_speed = 0;
+      for (auto next = start; running && next < end; next += desired_period)
+      {
+        std::this_thread::sleep_until(next);
+        mock_hub::UpdateDesired("{\"fan_speed\":" + std::to_string(++fan_speed) + "}");
+      }
+    });
+  }
+
+  // Each driver owns a slice of the devices and sends one message per device
+  // every period, recording how long SendMessage blocks the caller
+  std::vector<std::vector<std::uint64_t>> send_latencies(options.drivers);
+  std::vector<std::thread> drivers;
+  for (std::size_t d = 0; d < options.drivers; d++)
+  {
+    drivers.emplace_back([&, d]() {
+      for (auto next = start; next < end; next += period)
+      {
+        std::this_thread::sleep_until(next);
+        for (std::size_t i = d; i < devices.size(); i += options.drivers)
+        {
+          Device &device = devices[i];
+          auto before = clock_type::now();
+          try
+          {
+            device.connection->SendMessage(payload, props);
+            device.sent++;
+            if (options.report_every > 0 &&
+                device.sent % options.report_every == 0)
+            {
+              device.state.sequence++;
+              device.state.temperature = 20.0 + (device.sent % 50) / 10.0;
+              device.connection->SendReportState(device.state);
+            }
+          }
+          catch (const std::exception &)
+          {
+            send_failures++;
+          }
+          send_latencies[d].push_back(
+              std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  clock_type::now() - before)
+                  .count());
+        }
+      }
+    });
+  }
+  for (auto &driver : drivers)
+  {
+    driver.join();
+  }
+  const auto sent_at = clock_type::now();
+
+  // Wait for the hub to answer every message still in flight. The error
+  // callback also counts failed reports and uploads, so it can't tell.
+  std::uint64_t sent = 0;
+  for (const auto &device : devices)
+  {
+    sent += device.sent;
+  }
+  const auto drain_deadline =
+      sent_at + std::chrono::milliseconds(options.latency_ms) * 10 +
+      std::chrono::seconds(5);
+  while (clock_type::now() < drain_deadline)
+  {
+    mock_hub::Stats stats = mock_hub::Collect();
+    if (stats.confirmations + stats.message_errors >= sent)
+    {
+      break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  const auto drained_at = clock_type::now();
+
+  running = false;
+  sampler.join();
+  if (desired.joinable())
+  {
+    desired.join();
+  }
+
+  ProcessStatus loaded = ReadProcessStatus();
+  devices.clear();
+  pool.reset();
+  ProcessStatus after = ReadProcessStatus();
+
+  mock_hub::Stats stats = mock_hub::Collect();
+  std::vector<std::uint64_t> all_send_latencies;
+  for (const auto &samples : send_latencies)
+  {
+    all_send_latencies.insert(all_send_latencies.end(), samples.begin(),
+                              samples.end());
+  }
+
+  double send_seconds = std::chrono::duration<double>(sent_at - start).count();
+  double total_seconds =
+      std::chrono::duration<double>(drained_at - start).count();
+
+  json result = {
+      {"options",
+       {{"devices", options.devices},
+        {"rate", options.rate},
+        {"seconds", options.seconds},
+        {"payload", options.payload},
+        {"latency_ms", options.latency_ms},
+        {"failure_rate", options.failure_rate},
+        {"report_every", options.report_every},
+        {"delta", options.delta},
+        {"debounce_ms", options.debounce_ms},
+        {"desired_rate", options.desired_rate},
+        {"executor", options.executor},
+        {"drivers", options.drivers}}},
+      {"messages",
+       {{"sent", sent},
+        {"confirmed", stats.confirmations},
+        {"failed_by_hub", stats.message_errors},
+        {"send_failures", send_failures.load()},
+        {"error_callbacks", errors.load()},
+        {"offered_per_second", sent / send_seconds},
+        {"confirmed_per_second", stats.confirmations / total_seconds}}},
+      {"twin",
+       {{"reports", stats.reports},
+        {"twin_requests", stats.twin_requests},
+        {"desired_updates", stats.desired_updates},
+        {"state_callbacks", state_changes.load()}}},
+      {"bytes_to_hub", stats.bytes},
+      {"confirmation_latency", Percentiles(stats.confirmation_latencies)},
+      {"send_call_latency", Percentiles(all_send_latencies)},
+      {"memory_kb",
+       {{"baseline_rss", baseline.rss_kb},
+        {"peak_rss", loaded.peak_rss_kb},
+        {"loaded_rss", loaded.rss_kb},
+        {"after_teardown_rss", after.rss_kb}}},
+      {"threads",
+       {{"baseline", baseline.threads},
+        {"peak", peak.threads},
+        {"after_teardown", after.threads}}}};
+
+  std::cout << result.dump(2) << std::endl;
+
+  return stats.confirmations + stats.message_errors >= sent ? EXIT_SUCCESS
+                                                           : EXIT_FAILURE;
+}
@@ -0,0 +1,496 @@
+#include "loopback_server.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace bench;
+
+namespace
+{
+    const size_t chunk_size = 64 * 1024;
+
+    std::string to_lower(std::string s)
+    {
+        std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return std::tolower(c); });
+        return s;
+    }
+
+    std::string to_upper(std::string s)
+    {
+        std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return std::toupper(c); });
+        return s;
+    }
+
+    // Body of GET /bytes/N, written chunk_size bytes at a time
+    const std::string filler(chunk_size, 'x');
+} // namespace
+
+loopback_server::loopback_server() : listen_fd_(-1), port_(0), running_(false), bytes_received_(0), bytes_sent_(0) {}
+
+loopback_server::~loopback_server()
+{
+    stop();
+}
+
+void loopback_server::start()
+{
+    listen_fd_ = listen_on_loopback(port_);
+    running_ = true;
+    accept_thread_ = std::thread(&loopback_server::accept_loop, this);
+}
+
+void loopback_server::stop()
+{
+    if (!running_.exchange(false))
+    {
+        return;
+    }
+
+    shutdown(listen_fd_, SHUT_RDWR);
+    accept_thread_.join();
+    close(listen_fd_);
+
+    {
+        std::lock_guard<std::mutex> guard(connections_mutex_);
+        for (int fd : connection_fds_)
+        {
+            shutdown(fd, SHUT_RDWR);
+        }
+    }
+    for (auto &entry : connection_threads_)
+    {
+        entry.second.join();
+    }
+    connection_threads_.clear();
+    finished_threads_.clear();
+}
+
+uint16_t loopback_server::port() const
+{
+    return port_;
+}
+
+uint64_t loopback_server::bytes_received() const
+{
+    return bytes_received_;
+}
+
+uint64_t loopback_server::bytes_sent() const
+{
+    return bytes_sent_;
+}
+
+bool loopback_server::read_exactly(int fd, char *buffer, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t n = recv(fd, buffer, size, 0);
+        if (n <= 0)
+        {
+            return false;
+        }
+        bytes_received_ += n;
+        buffer += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool loopback_server::write_all(int fd, const char *buffer, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t n = send(fd, buffer, size, MSG_NOSIGNAL);
+        if (n <= 0)
+        {
+            return false;
+        }
+        bytes_sent_ += n;
+        buffer += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool loopback_server::read_line(int fd, std::string &buffer, std::string &line)
+{
+    char chunk[4096];
+    size_t end;
+    while ((end = buffer.find("\r\n")) == std::string::npos)
+    {
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0)
+        {
+            return false;
+        }
+        bytes_received_ += n;
+        buffer.append(chunk, n);
+    }
+
+    line.assign(buffer, 0, end);
+    buffer.erase(0, end + 2);
+    return true;
+}
+
+bool loopback_server::drain(int fd)
+{
+    std::vector<char> chunk(chunk_size);
+    ssize_t n;
+    while ((n = recv(fd, chunk.data(), chunk.size(), 0)) > 0)
+    {
+        bytes_received_ += n;
+    }
+    return n == 0;
+}
+
+int loopback_server::listen_on_loopback(uint16_t &port, bool reuse_address)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Couldn't create socket.");
+    }
+
+    if (reuse_address)
+    {
+        int yes = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    }
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+
+    socklen_t length = sizeof(address);
+    if (bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+        listen(fd, SOMAXCONN) != 0 ||
+        getsockname(fd, reinterpret_cast<sockaddr *>(&address), &length) != 0)
+    {
+        close(fd);
+        throw std::runtime_error("Couldn't listen on loopback.");
+    }
+
+    port = ntohs(address.sin_port);
+    return fd;
+}
+
+void loopback_server::track(int fd)
+{
+    std::lock_guard<std::mutex> guard(connections_mutex_);
+    connection_fds_.push_back(fd);
+    if (!running_)
+    {
+        shutdown(fd, SHUT_RDWR);
+    }
+}
+
+void loopback_server::abort_and_close(int fd)
+{
+    linger abort{1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_LINGER, &abort, sizeof(abort));
+    untrack_and_close(fd);
+}
+
+void loopback_server::untrack_and_close(int fd)
+{
+    {
+        std::lock_guard<std::mutex> guard(connections_mutex_);
+        connection_fds_.erase(std::remove(connection_fds_.begin(), connection_fds_.end(), fd), connection_fds_.end());
+    }
+    close(fd);
+}
+
+void loopback_server::accept_loop()
+{
+    while (running_)
+    {
+        int fd = accept(listen_fd_, nullptr, nullptr);
+        if (fd < 0)
+        {
+            continue;
+        }
+
+        int yes = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+        join_finished();
+
+        track(fd);
+        std::lock_guard<std::mutex> guard(connections_mutex_);
+        std::thread thread([this, fd]() {
+            serve(fd);
+            untrack_and_close(fd);
+
+            std::lock_guard<std::mutex> guard(connections_mutex_);
+            finished_threads_.push_back(std::this_thread::get_id());
+        });
+        connection_threads_.emplace(thread.get_id(), std::move(thread));
+    }
+}
+
+void loopback_server::join_finished()
+{
+    std::vector<std::thread> finished;
+    {
+        std::lock_guard<std::mutex> guard(connections_mutex_);
+        for (auto id : finished_threads_)
+        {
+            auto it = connection_threads_.find(id);
+            finished.push_back(std::move(it->second));
+            connection_threads_.erase(it);
+        }
+        finished_threads_.clear();
+    }
+
+    // They have only their return left, so this doesn't block
+    for (auto &t : finished)
+    {
+        t.join();
+    }
+}
+
+http_server::~http_server()
+{
+    stop();
+}
+
+std::string http_server::url() const
+{
+    return "http://127.0.0.1:" + std::to_string(port());
+}
+
+void http_server::serve(int fd)
+{
+    std::string buffer, line;
+    std::vector<char> scratch(chunk_size);
+
+    while (read_line(fd, buffer, line))
+    {
+        if (line.empty())
+        {
+            continue;
+        }
+
+        std::istringstream request_line(line);
+        std::string method, target;
+        request_line >> method >> target;
+
+        size_t content_length = 0;
+        bool expect_continue = false, keep_alive = true;
+        while (read_line(fd, buffer, line) && !line.empty())
+        {
+            size_t colon = line.find(':');
+            if (colon == std::string::npos)
+            {
+                continue;
+            }
+
+            size_t value_start = line.find_first_not_of(' ', colon + 1);
+            std::string name = to_lower(line.substr(0, colon));
+            std::string value = value_start == std::string::npos ? "" : to_lower(line.substr(value_start));
+            if (name == "content-length")
+            {
+                content_length = std::stoul(value);
+            }
+            else if (name == "expect" && value == "100-continue")
+            {
+                expect_continue = true;
+            }
+            else if (name == "connection" && value == "close")
+            {
+                keep_alive = false;
+            }
+        }
+
+        if (expect_continue)
+        {
+            const char continue_response[] = "HTTP/1.1 100 Continue\r\n\r\n";
+            write_all(fd, continue_response, sizeof(continue_response) - 1);
+        }
+
+        // Discard the body, part of which may already be buffered
+        size_t buffered = std::min(content_length, buffer.size());
+        buffer.erase(0, buffered);
+        for (size_t left = content_length - buffered; left > 0;)
+        {
+            size_t n = std::min(left, scratch.size());
+            if (!read_exactly(fd, scratch.data(), n))
+            {
+                return;
+            }
+            left -= n;
+        }
+
+        std::string status = "200 OK", content_type = "application/json", body;
+        size_t body_size = 0;
+        bool fill = false;
+
+        if (method == "GET" && target.rfind("/bytes/", 0) == 0)
+        {
+            body_size = std::stoul(target.substr(7));
+            content_type = "application/octet-stream";
+            fill = true;
+        }
+        else if (method == "POST")
+        {
+            body = "{\"received\":" + std::to_string(content_length) + "}";
+            body_size = body.size();
+        }
+        else
+        {
+            status = "404 Not Found";
+        }
+
+        std::string header = "HTTP/1.1 " + status + "\r\n" +
+                             "Content-Type: " + content_type + "\r\n" +
+                             "Content-Length: " + std::to_string(body_size) + "\r\n" +
+                             (keep_alive ? "" : "Connection: close\r\n") + "\r\n";
+
+        if (!write_all(fd, header.data(), header.size()))
+        {
+            return;
+        }
+        for (size_t left = body_size; fill && left > 0;)
+        {
+            size_t n = std::min(left, filler.size());
+            if (!write_all(fd, filler.data(), n))
+            {
+                return;
+            }
+            left -= n;
+        }
+        if ((!fill && !write_all(fd, body.data(), body.size())) || !keep_alive)
+        {
+            return;
+        }
+    }
+}
+
+ftp_server::~ftp_server()
+{
+    stop();
+}
+
+std::string ftp_server::url() const
+{
+    return "ftp://127.0.0.1:" + std::to_string(port());
+}
+
+void ftp_server::serve(int fd)
+{
+    std::string buffer, line;
+    int passive_fd = -1;
+    uint16_t data_port = 0;
+
+    auto reply = [&](const std::string &message) {
+        std::string text = message + "\r\n";
+        return write_all(fd, text.data(), text.size());
+    };
+
+    if (!reply("220 cpputils bench"))
+    {
+        return;
+    }
+
+    while (read_line(fd, buffer, line))
+    {
+        size_t space = line.find(' ');
+        std::string command = to_upper(line.substr(0, space));
+        bool ok = true;
+
+        if (command == "USER")
+        {
+            ok = reply("331 Password required");
+        }
+        else if (command == "PASS")
+        {
+            ok = reply("230 Logged in");
+        }
+        else if (command == "PWD")
+        {
+            ok = reply("257 \"/\"");
+        }
+        else if (command == "CWD")
+        {
+            ok = reply("250 OK");
+        }
+        else if (command == "TYPE")
+        {
+            ok = reply("200 OK");
+        }
+        else if (command == "EPSV" || command == "PASV")
+        {
+            // Reusing one listener keeps the session on a single data port
+            // instead of binding a fresh ephemeral port per transfer.
+            if (passive_fd < 0)
+            {
+                passive_fd = listen_on_loopback(data_port, false);
+                track(passive_fd);
+            }
+
+            if (command == "EPSV")
+            {
+                ok = reply("229 Entering Extended Passive Mode (|||" + std::to_string(data_port) + "|)");
+            }
+            else
+            {
+                ok = reply("227 Entering Passive Mode (127,0,0,1," + std::to_string(data_port >> 8) + "," +
+                           std::to_string(data_port & 0xff) + ")");
+            }
+        }
+        else if (command == "STOR")
+        {
+            if (passive_fd < 0)
+            {
+                ok = reply("425 Use PASV first");
+                continue;
+            }
+
+            ok = reply("150 Ok to send data");
+            int data_fd = accept(passive_fd, nullptr, nullptr);
+            if (data_fd < 0)
+            {
+                ok = reply("425 Can't open data connection");
+                continue;
+            }
+
+            // The client closes first once it has sent everything, so a
+            // plain close would leave one TIME_WAIT pair per transfer on the
+            // client side and exhaust the ephemeral ports during a run.
+            track(data_fd);
+            bool complete = drain(data_fd);
+            abort_and_close(data_fd);
+
+            ok = ok && reply(complete ? "226 Transfer complete" : "426 Transfer aborted");
+        }
+        else if (command == "QUIT")
+        {
+            reply("221 Bye");
+            break;
+        }
+        else
+        {
+            ok = reply("502 Command not implemented");
+        }
+
+        if (!ok)
+        {
+            break;
+        }
+    }
+
+    if (passive_fd >= 0)
+    {
+        untrack_and_close(passive_fd);
+    }
+}
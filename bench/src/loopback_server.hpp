@@ -0,0 +1,95 @@
+#ifndef BENCH_LOOPBACK_SERVER_HPP
+#define BENCH_LOOPBACK_SERVER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace bench
+{
+    // Listens on 127.0.0.1 with an ephemeral port and serves every accepted
+    // connection on its own thread until stop() is called. Finished threads
+    // are joined as new connections come in. Subclasses must call stop() in
+    // their destructor, as the threads call serve().
+    class loopback_server
+    {
+    public:
+        loopback_server();
+        virtual ~loopback_server();
+
+        void start();
+        void stop();
+
+        uint16_t port() const;
+        uint64_t bytes_received() const;
+        uint64_t bytes_sent() const;
+
+    protected:
+        virtual void serve(int fd) = 0;
+
+        // These return false once the peer is gone. read_line keeps what it
+        // read past the line in buffer; drain reads until the peer closes.
+        bool read_exactly(int fd, char *buffer, size_t size);
+        bool write_all(int fd, const char *buffer, size_t size);
+        bool read_line(int fd, std::string &buffer, std::string &line);
+        bool drain(int fd);
+
+        // Only the main listener sets SO_REUSEADDR; an ephemeral data
+        // listener must not be bound over a port with lingering connections.
+        int listen_on_loopback(uint16_t &port, bool reuse_address = true);
+
+        // Closes with an RST so the peer's socket doesn't sit in TIME_WAIT
+        void abort_and_close(int fd);
+
+        // Tracked sockets are shut down by stop(), so no thread stays blocked
+        void track(int fd);
+        void untrack_and_close(int fd);
+
+    private:
+        int listen_fd_;
+        uint16_t port_;
+        std::thread accept_thread_;
+        std::map<std::thread::id, std::thread> connection_threads_;
+        std::vector<std::thread::id> finished_threads_;
+        std::vector<int> connection_fds_;
+        std::mutex connections_mutex_;
+        std::atomic<bool> running_;
+        std::atomic<uint64_t> bytes_received_, bytes_sent_;
+
+        void accept_loop();
+        void join_finished();
+    };
+
+    // Minimal HTTP/1.1 server with keep-alive:
+    //   GET /bytes/N  answers with N bytes
+    //   POST <any>    consumes the body and answers with a small JSON
+    class http_server : public loopback_server
+    {
+    public:
+        ~http_server() override;
+
+        std::string url() const;
+
+    protected:
+        void serve(int fd) override;
+    };
+
+    // Minimal passive-mode FTP server that accepts and discards STOR uploads.
+    // Each control connection keeps one passive listener for all its transfers.
+    class ftp_server : public loopback_server
+    {
+    public:
+        ~ftp_server() override;
+
+        std::string url() const;
+
+    protected:
+        void serve(int fd) override;
+    };
+} // namespace bench
+
+#endif
@@ -0,0 +1,514 @@
+// Benchmarks curl::get, curl::post_json and ftp_curl::send_file against
+// loopback servers, printing one JSON object per line:
+//
+//   bench --seconds 2 --sizes 64,65536 --concurrency 1,8 --output web.jsonl
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+#include <web/curl.hpp>
+#include <web/ftp.hpp>
+
+#include "loopback_server.hpp"
+
+using json = nlohmann::json;
+using clock_type = std::chrono::steady_clock;
+
+namespace
+{
+    struct allocation_counter
+    {
+        uint64_t cpp_count = 0, cpp_bytes = 0;
+        uint64_t curl_count = 0, curl_bytes = 0;
+    };
+
+    // Only the benchmark threads count, the servers share the process
+    thread_local bool counting = false;
+    thread_local allocation_counter allocations;
+
+    void *count_curl(void *p, size_t size)
+    {
+        if (counting)
+        {
+            allocations.curl_count++;
+            allocations.curl_bytes += size;
+        }
+        return p;
+    }
+
+    void *curl_malloc(size_t size)
+    {
+        return count_curl(std::malloc(size), size);
+    }
+
+    void *curl_realloc(void *p, size_t size)
+    {
+        return count_curl(std::realloc(p, size), size);
+    }
+
+    void *curl_calloc(size_t count, size_t size)
+    {
+        return count_curl(std::calloc(count, size), count * size);
+    }
+
+    char *curl_strdup(const char *s)
+    {
+        size_t size = std::strlen(s) + 1;
+        char *p = static_cast<char *>(curl_malloc(size));
+        if (p != nullptr)
+        {
+            std::memcpy(p, s, size);
+        }
+        return p;
+    }
+} // namespace
+
+void *operator new(size_t size)
+{
+    if (counting)
+    {
+        allocations.cpp_count++;
+        allocations.cpp_bytes += size;
+    }
+
+    void *p = std::malloc(size == 0 ? 1 : size);
+    if (p == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace
+{
+    enum class operation
+    {
+        get,
+        post_json,
+        ftp_send_file
+    };
+
+    const char *operation_name(operation op)
+    {
+        switch (op)
+        {
+        case operation::get:
+            return "get";
+        case operation::post_json:
+            return "post_json";
+        default:
+            return "ftp_send_file";
+        }
+    }
+
+    struct options
+    {
+        double seconds = 1.0;
+        size_t warmup = 3;
+        std::vector<size_t> sizes{64, 4096, 65536, 1048576};
+        std::vector<size_t> concurrency{1, 4, 16};
+        std::vector<operation> operations{operation::get, operation::post_json, operation::ftp_send_file};
+        std::string output;
+    };
+
+    struct worker_result
+    {
+        std::vector<uint64_t> latencies_ns;
+        uint64_t errors = 0;
+        allocation_counter allocations;
+    };
+
+    [[noreturn]] void usage(const char *program)
+    {
+        std::cerr << "Usage: " << program << " [options]\n"
+                  << "  --seconds S          duration of each case (1)\n"
+                  << "  --warmup N           untimed requests per worker (3)\n"
+                  << "  --sizes A,B,...      payload sizes in bytes (64,4096,65536,1048576)\n"
+                  << "  --concurrency A,...  parallel clients (1,4,16)\n"
+                  << "  --only OP,...        get, post_json and/or ftp_send_file\n"
+                  << "  --output FILE        also append the results to FILE\n";
+        std::exit(EXIT_FAILURE);
+    }
+
+    std::vector<std::string> split(const std::string &list)
+    {
+        std::vector<std::string> items;
+        size_t start = 0, end;
+        while ((end = list.find(',', start)) != std::string::npos)
+        {
+            items.push_back(list.substr(start, end - start));
+            start = end + 1;
+        }
+        items.push_back(list.substr(start));
+        return items;
+    }
+
+    std::vector<size_t> split_sizes(const std::string &list)
+    {
+        std::vector<size_t> sizes;
+        for (const auto &item : split(list))
+        {
+            sizes.push_back(std::stoul(item));
+        }
+        return sizes;
+    }
+
+    options parse_options(int argc, char **argv)
+    {
+        options opts;
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            if (i + 1 >= argc)
+            {
+                usage(argv[0]);
+            }
+            std::string value = argv[++i];
+
+            if (arg == "--seconds")
+                opts.seconds = std::stod(value);
+            else if (arg == "--warmup")
+                opts.warmup = std::stoul(value);
+            else if (arg == "--sizes")
+                opts.sizes = split_sizes(value);
+            else if (arg == "--concurrency")
+                opts.concurrency = split_sizes(value);
+            else if (arg == "--output")
+                opts.output = value;
+            else if (arg == "--only")
+            {
+                opts.operations.clear();
+                for (const auto &name : split(value))
+                {
+                    if (name == "get")
+                        opts.operations.push_back(operation::get);
+                    else if (name == "post_json")
+                        opts.operations.push_back(operation::post_json);
+                    else if (name == "ftp_send_file")
+                        opts.operations.push_back(operation::ftp_send_file);
+                    else
+                        usage(argv[0]);
+                }
+            }
+            else
+                usage(argv[0]);
+        }
+
+        if (opts.seconds <= 0.0 || opts.sizes.empty() || opts.concurrency.empty() ||
+            std::find(opts.concurrency.begin(), opts.concurrency.end(), 0) != opts.concurrency.end())
+        {
+            usage(argv[0]);
+        }
+        return opts;
+    }
+
+    // One client per worker, reused for every request like an application would
+    class client
+    {
+    public:
+        client(operation op, size_t size, const std::string &http_url, const std::string &ftp_url)
+            : op_(op), ftp_(ftp_url, "bench:bench")
+        {
+            if (op == operation::get)
+            {
+                url_ = http_url + "/bytes/" + std::to_string(size);
+            }
+            else if (op == operation::post_json)
+            {
+                url_ = http_url + "/post";
+                body_ = "{\"data\":\"" + std::string(size > 11 ? size - 11 : 0, 'x') + "\"}";
+            }
+            else
+            {
+                file_.assign(size, 'x');
+            }
+        }
+
+        void run()
+        {
+            switch (op_)
+            {
+            case operation::get:
+                http_.get(url_);
+                break;
+            case operation::post_json:
+                http_.post_json(url_, body_);
+                break;
+            default:
+                ftp_.send_file("bench.bin", file_);
+                break;
+            }
+        }
+
+    private:
+        operation op_;
+        web::curl http_;
+        web::ftp_curl ftp_;
+        std::string url_, body_;
+        web::byte_buffer file_;
+    };
+
+    json latency_summary(const std::vector<uint64_t> &sorted)
+    {
+        if (sorted.empty())
+        {
+            return json::object();
+        }
+
+        auto at = [&](double p) { return sorted[static_cast<size_t>(p * (sorted.size() - 1))] / 1000.0; };
+        double total = 0;
+        for (uint64_t ns : sorted)
+        {
+            total += ns;
+        }
+
+        return {{"mean", total / sorted.size() / 1000.0},
+                {"p50", at(0.50)},
+                {"p90", at(0.90)},
+                {"p99", at(0.99)},
+                {"p999", at(0.999)},
+                {"max", sorted.back() / 1000.0}};
+    }
+
+    // Power of two buckets, "le" being the inclusive upper bound in us
+    json latency_histogram(const std::vector<uint64_t> &sorted)
+    {
+        json histogram = json::array();
+        auto it = sorted.begin();
+        for (uint64_t le_us = 1; it != sorted.end(); le_us *= 2)
+        {
+            auto next = std::upper_bound(it, sorted.end(), le_us * 1000);
+            if (next != it)
+            {
+                histogram.push_back({{"le", le_us}, {"count", next - it}});
+            }
+            it = next;
+        }
+        return histogram;
+    }
+
+    // A loopback transfer takes microseconds plus the payload at well over
+    // 50 MB/s. When even the fastest request is slower than this, every one
+    // waited on some fixed timeout and the numbers don't measure the code.
+    //
+    // One such timeout is known and outside this code: on a reused FTP
+    // connection, libcurl 7.88 (8.14 is fine) starts the passive data connect
+    // only the next time it wakes up, but polls no socket meanwhile, so each
+    // upload after the first waits out curl_easy_perform's 1 s poll timeout.
+    // The first one is woken by the reply to TYPE. Nothing the server sends
+    // can help, so ftp_send_file stalls are reported as a warning and don't
+    // fail the run.
+    bool dominated_by_stall(const std::vector<uint64_t> &sorted, size_t size)
+    {
+        const uint64_t stall_ns = 200000000, ns_per_byte = 20;
+        return !sorted.empty() && sorted.front() > stall_ns + size * ns_per_byte;
+    }
+
+    json run_case(operation op, size_t size, size_t concurrency, const options &opts, bench::http_server &http,
+                  bench::ftp_server &ftp)
+    {
+        std::vector<worker_result> results(concurrency);
+        std::vector<std::thread> workers;
+        std::atomic<size_t> ready{0};
+        std::atomic<bool> go{false};
+        clock_type::time_point deadline;
+
+        for (size_t w = 0; w < concurrency; w++)
+        {
+            workers.emplace_back([&, w]() {
+                worker_result &result = results[w];
+                std::unique_ptr<client> c;
+
+                try
+                {
+                    c = std::make_unique<client>(op, size, http.url(), ftp.url());
+                    for (size_t i = 0; i < opts.warmup; i++)
+                    {
+                        c->run();
+                    }
+                }
+                catch (const std::exception &)
+                {
+                    result.errors++;
+                    ready++;
+                    return;
+                }
+
+                ready++;
+                while (!go)
+                {
+                    std::this_thread::yield();
+                }
+
+                allocations = allocation_counter();
+                counting = true;
+                while (clock_type::now() < deadline)
+                {
+                    auto start = clock_type::now();
+                    try
+                    {
+                        c->run();
+                    }
+                    catch (const std::exception &)
+                    {
+                        result.errors++;
+                    }
+                    result.latencies_ns.push_back(
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - start).count());
+                }
+                counting = false;
+                result.allocations = allocations;
+            });
+        }
+
+        while (ready < concurrency)
+        {
+            std::this_thread::yield();
+        }
+        auto wire_start = http.bytes_received() + http.bytes_sent() + ftp.bytes_received() + ftp.bytes_sent();
+        auto start = clock_type::now();
+        deadline = start + std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(opts.seconds));
+        go = true;
+
+        for (auto &t : workers)
+        {
+            t.join();
+        }
+        double elapsed = std::chrono::duration<double>(clock_type::now() - start).count();
+        uint64_t wire = http.bytes_received() + http.bytes_sent() + ftp.bytes_received() + ftp.bytes_sent() - wire_start;
+
+        std::vector<uint64_t> latencies;
+        allocation_counter total_allocations;
+        uint64_t errors = 0;
+        for (const auto &result : results)
+        {
+            latencies.insert(latencies.end(), result.latencies_ns.begin(), result.latencies_ns.end());
+            errors += result.errors;
+            total_allocations.cpp_count += result.allocations.cpp_count;
+            total_allocations.cpp_bytes += result.allocations.cpp_bytes;
+            total_allocations.curl_count += result.allocations.curl_count;
+            total_allocations.curl_bytes += result.allocations.curl_bytes;
+        }
+        std::sort(latencies.begin(), latencies.end());
+
+        double requests = latencies.empty() ? 1.0 : static_cast<double>(latencies.size());
+        json result = {{"benchmark", operation_name(op)},
+                       {"payload_bytes", size},
+                       {"concurrency", concurrency},
+                       {"seconds", elapsed},
+                       {"requests", latencies.size()},
+                       {"errors", errors},
+                       {"requests_per_second", latencies.size() / elapsed},
+                       {"payload_mib_per_second", latencies.size() * size / elapsed / (1024.0 * 1024.0)},
+                       {"latency_us", latency_summary(latencies)},
+                       {"latency_histogram_us", latency_histogram(latencies)},
+                       {"wire_bytes_per_request", wire / requests},
+                       {"allocations_per_request",
+                        {{"cpp", total_allocations.cpp_count / requests}, {"curl", total_allocations.curl_count / requests}}},
+                       {"allocated_bytes_per_request",
+                        {{"cpp", total_allocations.cpp_bytes / requests}, {"curl", total_allocations.curl_bytes / requests}}}};
+
+        if (dominated_by_stall(latencies, size))
+        {
+            std::string message = "every request took at least " + std::to_string(latencies.front() / 1000000) +
+                                  " ms, the latency is dominated by a fixed stall";
+            if (op == operation::ftp_send_file)
+            {
+                result["warning"] = message + " (libcurl's poll timeout before each passive data connect)";
+            }
+            else
+            {
+                result["error"] = message;
+            }
+        }
+        return result;
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    options opts = parse_options(argc, argv);
+
+    // Before any web::curl, so libcurl allocations go through the counters
+    if (curl_global_init_mem(CURL_GLOBAL_DEFAULT, curl_malloc, std::free, curl_realloc, curl_strdup, curl_calloc) !=
+        CURLE_OK)
+    {
+        std::cerr << "Couldn't initialize curl." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::ofstream file;
+    if (!opts.output.empty())
+    {
+        file.open(opts.output, std::ios::app);
+    }
+    auto emit = [&](const json &line) {
+        std::cout << line.dump() << std::endl;
+        if (file.is_open())
+        {
+            file << line.dump() << std::endl;
+        }
+    };
+
+    bench::http_server http;
+    bench::ftp_server ftp;
+    http.start();
+    ftp.start();
+
+    emit({{"benchmark", "meta"},
+          {"cpputils_version", CPPUTILS_VERSION},
+          {"curl_version", curl_version()},
+          {"hardware_concurrency", std::thread::hardware_concurrency()}});
+
+    bool failed = false;
+    for (operation op : opts.operations)
+    {
+        for (size_t size : opts.sizes)
+        {
+            for (size_t concurrency : opts.concurrency)
+            {
+                try
+                {
+                    json result = run_case(op, size, concurrency, opts, http, ftp);
+                    failed = failed || result["errors"].get<uint64_t>() > 0 || result.contains("error");
+                    emit(result);
+                }
+                catch (const std::exception &e)
+                {
+                    failed = true;
+                    emit({{"benchmark", operation_name(op)},
+                          {"payload_bytes", size},
+                          {"concurrency", concurrency},
+                          {"error", e.what()}});
+                }
+            }
+        }
+    }
+
+    http.stop();
+    ftp.stop();
+    curl_global_cleanup();
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
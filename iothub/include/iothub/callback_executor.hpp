@@ -0,0 +1,302 @@
+#ifndef IOT_HUB_CALLBACK_EXECUTOR
+#define IOT_HUB_CALLBACK_EXECUTOR
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace iothub
+{
+  // Multi-producer single-consumer queue (Vyukov). Push is wait-free, so the
+  // SDK threads never block on it; only one thread may Pop at a time. Pop can
+  // miss an element whose Push is still in progress.
+  template <typename T>
+  class MpscQueue
+  {
+  public:
+    MpscQueue() : head_(new Node()), tail_(head_.load()) {}
+
+    MpscQueue(const MpscQueue &) = delete;
+    MpscQueue &operator=(const MpscQueue &) = delete;
+
+    ~MpscQueue()
+    {
+      T value;
+      while (Pop(value))
+      {
+      }
+      delete tail_;
+    }
+
+    void Push(T value)
+    {
+      Node *node = new Node(std::move(value));
+      Node *previous = head_.exchange(node, std::memory_order_acq_rel);
+      previous->next.store(node, std::memory_order_release);
+    }
+
+    bool Pop(T &value)
+    {
+      Node *next = tail_->next.load(std::memory_order_acquire);
+      if (next == nullptr)
+      {
+        return false;
+      }
+
+      value = std::move(next->value);
+      delete tail_;
+      tail_ = next;
+      return true;
+    }
+
+  private:
+    struct Node
+    {
+      Node() = default;
+      explicit Node(T v) : value(std::move(v)) {}
+
+      T value;
+      std::atomic<Node *> next{nullptr};
+    };
+
+    std::atomic<Node *> head_;
+    Node *tail_;
+  };
+
+  class CallbackExecutor
+  {
+  public:
+    using Task = std::function<void()>;
+
+    virtual ~CallbackExecutor() = default;
+
+    virtual void Post(Task task) = 0;
+  };
+
+  // Runs the callback on the calling (SDK) thread
+  class InlineExecutor : public CallbackExecutor
+  {
+  public:
+    void Post(Task task) override
+    {
+      task();
+    }
+  };
+
+  // Worker threads shared by several connections. Callbacks are posted to a
+  // strand, which runs them one at a time and in order on any of the workers.
+  // The pool must outlive every connection using one of its strands.
+  class ThreadPoolExecutor
+  {
+    class Strand;
+
+  public:
+    explicit ThreadPoolExecutor(
+        std::size_t threads = std::thread::hardware_concurrency())
+    {
+      if (threads == 0)
+      {
+        threads = 1;
+      }
+      for (std::size_t i = 0; i < threads; i++)
+      {
+        workers_.emplace_back(&ThreadPoolExecutor::Work, this);
+      }
+    }
+
+    ThreadPoolExecutor(const ThreadPoolExecutor &) = delete;
+    ThreadPoolExecutor &operator=(const ThreadPoolExecutor &) = delete;
+
+    // Pending callbacks are run before the workers are joined
+    ~ThreadPoolExecutor()
+    {
+      stop_.store(true);
+      for (std::size_t i = 0; i < workers_.size(); i++)
+      {
+        Wake();
+      }
+      for (auto &worker : workers_)
+      {
+        worker.join();
+      }
+    }
+
+    std::shared_ptr<CallbackExecutor> MakeStrand()
+    {
+      return std::make_shared<Strand>(this);
+    }
+
+  private:
+    // pending_ counts the tasks posted and not yet run. The Post taking it
+    // from zero schedules the strand, and Run only reschedules it when tasks
+    // were posted meanwhile, so at most one worker runs it and only that
+    // worker pops from tasks_.
+    class Strand : public CallbackExecutor,
+                   public std::enable_shared_from_this<Strand>
+    {
+    public:
+      explicit Strand(ThreadPoolExecutor *pool) : pool_(pool) {}
+
+      void Post(Task task) override
+      {
+        // Counted before the push, so pending_ never drops below the number
+        // of queued tasks
+        bool idle = pending_.fetch_add(1, std::memory_order_acq_rel) == 0;
+        tasks_.Push(std::move(task));
+        if (idle)
+        {
+          pool_->Schedule(shared_from_this());
+        }
+      }
+
+      void Run()
+      {
+        Task task;
+        std::size_t ran = 0;
+        for (; ran < kBatch && tasks_.Pop(task); ran++)
+        {
+          try
+          {
+            task();
+          }
+          catch (...)
+          {
+            // Nowhere to report it, keep the strand alive
+          }
+        }
+
+        if (ran == 0)
+        {
+          // A Post is between its count and its push
+          std::this_thread::yield();
+        }
+
+        // Nothing may touch the strand once this brings pending_ to zero
+        if (pending_.fetch_sub(ran, std::memory_order_acq_rel) != ran)
+        {
+          pool_->Schedule(shared_from_this());
+        }
+      }
+
+    private:
+      // Yield to other strands after this many callbacks
+      static constexpr std::size_t kBatch = 64;
+
+      ThreadPoolExecutor *pool_;
+      MpscQueue<Task> tasks_;
+      std::atomic<std::size_t> pending_{0};
+    };
+
+    std::vector<std::thread> workers_;
+    MpscQueue<std::shared_ptr<Strand>> ready_;
+    std::atomic<std::size_t> queued_{0};
+    std::atomic<bool> stop_{false};
+    std::mutex pop_mutex_;
+    std::atomic<std::size_t> wakeups_{0};
+    std::atomic<std::size_t> sleeping_{0};
+    std::mutex sleep_mutex_;
+    std::condition_variable wakeup_cv_;
+
+    void Schedule(std::shared_ptr<Strand> strand)
+    {
+      queued_.fetch_add(1, std::memory_order_relaxed);
+      ready_.Push(std::move(strand));
+      Wake();
+    }
+
+    // A counting semaphore: one wakeup per queued strand. Producers only
+    // take sleep_mutex_ when a worker is asleep. sleeping_ is raised before
+    // a worker's last look at wakeups_, and wakeups_ before a producer looks
+    // at sleeping_, so (all seq_cst) at least one of them sees the other.
+    void Wake()
+    {
+      wakeups_.fetch_add(1);
+      if (sleeping_.load() > 0)
+      {
+        // The sleeper is either waiting already or still holds the mutex
+        // and will see the wakeup
+        {
+          std::lock_guard<std::mutex> guard(sleep_mutex_);
+        }
+        wakeup_cv_.notify_one();
+      }
+    }
+
+    bool TakeWakeup()
+    {
+      std::size_t wakeups = wakeups_.load();
+      while (wakeups > 0)
+      {
+        if (wakeups_.compare_exchange_weak(wakeups, wakeups - 1))
+        {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    void WaitForWakeup()
+    {
+      if (TakeWakeup())
+      {
+        return;
+      }
+
+      std::unique_lock<std::mutex> lock(sleep_mutex_);
+      sleeping_.fetch_add(1);
+      wakeup_cv_.wait(lock, [this] { return TakeWakeup(); });
+      sleeping_.fetch_sub(1);
+    }
+
+    // pop_mutex_ keeps ready_ single consumer; only workers holding a wakeup
+    // contend on it. The destructor adds one wakeup per worker with nothing
+    // queued behind it, which is how a worker finds out it should exit.
+    void Work()
+    {
+      while (true)
+      {
+        WaitForWakeup();
+
+        std::shared_ptr<Strand> strand;
+        {
+          std::lock_guard<std::mutex> guard(pop_mutex_);
+          while (!ready_.Pop(strand))
+          {
+            if (stop_.load() && queued_.load() == 0)
+            {
+              return;
+            }
+            // The strand of this wakeup is still being pushed
+            std::this_thread::yield();
+          }
+        }
+        queued_.fetch_sub(1, std::memory_order_relaxed);
+
+        strand->Run();
+      }
+    }
+  };
+
+  // A single thread owned by one connection
+  class ThreadExecutor : public CallbackExecutor
+  {
+  public:
+    ThreadExecutor() : pool_(1), strand_(pool_.MakeStrand()) {}
+
+    void Post(Task task) override
+    {
+      strand_->Post(std::move(task));
+    }
+
+  private:
+    ThreadPoolExecutor pool_;
+    std::shared_ptr<CallbackExecutor> strand_;
+  };
+} // namespace iothub
+
+#endif // !IOT_HUB_CALLBACK_EXECUTOR
@@ -1,12 +1,22 @@
 #ifndef IOT_HUB_CONNECTION
 #define IOT_HUB_CONNECTION
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
 #include <cstdlib>
 #include <exception>
 #include <future>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <stdexcept>
+#include <thread>
+#include <type_traits>
+
+#include <iothub/callback_executor.hpp>
+#include <iothub/merge_patch.hpp>
+#include <iothub/reflection.hpp>
 
 #include <iothub.h>
 #include <iothub_client.h>
@@ -20,15 +30,36 @@ using json = nlohmann::json;
 namespace
 {
   const std::chrono::milliseconds IOT_HUB_TIMEOUT(30000);
+  const std::chrono::milliseconds REPORT_RETRY_DELAY(1000);
+  const std::chrono::milliseconds REPORT_RETRY_MAX_DELAY(60000);
 }
 
 namespace iothub
 {
+  // Specialize for T, or describe T with IOTHUB_REFLECT to get these for free.
+  // Reflected types skip the string round-trips on the twin and report paths.
   template <typename T>
   struct Converters
   {
-    static T FromJson(const std::string &json_string);
-    static std::string ToJson(const T &value);
+    static T FromJson(const std::string &json_string)
+    {
+      static_assert(Reflection<T>::reflected,
+                    "Specialize Converters<T> or use IOTHUB_REFLECT(T, ...)");
+
+      T value{};
+      ReadFields(json::parse(json_string), value);
+      return value;
+    }
+
+    static std::string ToJson(const T &value)
+    {
+      static_assert(Reflection<T>::reflected,
+                    "Specialize Converters<T> or use IOTHUB_REFLECT(T, ...)");
+
+      json j = json::object();
+      WriteFields(value, j);
+      return j.dump();
+    }
   };
 
   template <typename StateType>
@@ -41,6 +72,17 @@ namespace iothub
     using ErrorCallback = std::function<void()>;
     using Properties = std::map<std::string, std::string>;
 
+    enum class ReportMode
+    {
+      // Send the whole state on every report
+      Full,
+      // Send a JSON merge-patch against the last reported state. A patch
+      // that failed for a reason that may go away (no answer, 408, 429, 5xx)
+      // is followed by a full report of the latest state, retried with an
+      // exponential backoff. After any other failure the next report is full.
+      Delta
+    };
+
     class IoTHubConnectionInitException : public std::runtime_error
     {
     public:
@@ -124,6 +166,16 @@ namespace iothub
 
     virtual ~IoTHubConnection()
     {
+      {
+        std::lock_guard<std::mutex> guard(report_mutex_);
+        report_stop_ = true;
+      }
+      report_cv_.notify_all();
+      if (report_thread_.joinable())
+      {
+        report_thread_.join();
+      }
+
       IoTHubDeviceClient_Destroy(client_handle_);
       IoTHub_Deinit();
     }
@@ -146,6 +198,17 @@ namespace iothub
       error_callback_ = callback;
     }
 
+    // Callbacks run on the SDK thread by default. Pass a ThreadExecutor, or a
+    // strand from a shared ThreadPoolExecutor, to keep slow handlers off it.
+    void SetCallbackExecutor(std::shared_ptr<CallbackExecutor> executor)
+    {
+      if (!executor)
+      {
+        executor = std::make_shared<InlineExecutor>();
+      }
+      std::atomic_store(&executor_, executor);
+    }
+
     StateType GetState()
     {
       std::promise<StateType> promise;
@@ -157,8 +220,15 @@ namespace iothub
             std::promise<StateType> *result =
                 reinterpret_cast<std::promise<StateType> *>(user_context_callback);
 
-            json config = json::parse(payload, payload + size)["desired"];
-            result->set_value(Converters<StateType>::FromJson(config.dump()));
+            try
+            {
+              json config = json::parse(payload, payload + size)["desired"];
+              result->set_value(StateFromJson(config));
+            }
+            catch (const std::exception &)
+            {
+              result->set_exception(std::current_exception());
+            }
           },
           &promise);
 
@@ -174,17 +244,46 @@ namespace iothub
       return state;
     }
 
+    // In Delta mode only the properties that changed since the last report
+    // are sent. A non-zero debounce coalesces every report made within the
+    // window into a single request, sent from a background thread.
+    void SetReportMode(ReportMode mode, std::chrono::milliseconds debounce =
+                                            std::chrono::milliseconds(0))
+    {
+      std::lock_guard<std::mutex> guard(report_mutex_);
+      report_mode_ = mode;
+      report_debounce_ = debounce;
+
+      if (debounce.count() > 0 && !report_thread_.joinable())
+      {
+        report_thread_ = std::thread(&IoTHubConnection::ReportLoop, this);
+      }
+    }
+
     void SendReportState(const StateType &state)
     {
-      std::string json_str = Converters<StateType>::ToJson(state);
+      {
+        std::lock_guard<std::mutex> guard(report_mutex_);
+        if (report_debounce_.count() > 0)
+        {
+          if (!has_pending_report_)
+          {
+            report_deadline_ =
+                std::chrono::steady_clock::now() + report_debounce_;
+            has_pending_report_ = true;
+          }
+          pending_report_ = state;
+          report_cv_.notify_all();
+
+          SetState(state);
+          return;
+        }
 
-      const unsigned char *payload =
-          reinterpret_cast<const unsigned char *>(json_str.c_str());
-      auto ok = IoTHubDeviceClient_SendReportedState(
-          client_handle_, payload, json_str.size(), SendReportStateCallback,
-          this);
+        // A newer state supersedes whatever is still waiting to be sent
+        has_pending_report_ = false;
+      }
 
-      if (ok != IOTHUB_CLIENT_OK)
+      if (!PublishReport(state))
       {
         throw IoTHubConnectionRequestException("Could't send request to IoTHub");
       }
@@ -194,8 +293,10 @@ namespace iothub
 
     void SendMessage(const std::string &msg, const Properties &props)
     {
-      IOTHUB_MESSAGE_HANDLE message_handle =
-          IoTHubMessage_CreateFromString(msg.c_str());
+      // The SDK keeps its own copy of the message
+      MessagePtr message(IoTHubMessage_CreateFromString(msg.c_str()),
+                         IoTHubMessage_Destroy);
+      IOTHUB_MESSAGE_HANDLE message_handle = message.get();
 
       if (message_handle == nullptr)
       {
@@ -218,14 +319,20 @@ namespace iothub
       SetProperties(message_handle, props);
 
       std::size_t tracking_id = tracking_id_count++;
-      messages.emplace(tracking_id,
-                       SendMessageContext{tracking_id, this, msg, props});
+      SendMessageContext *context;
+      {
+        std::lock_guard<std::mutex> guard(messages_mutex_);
+        context = &messages
+                       .emplace(tracking_id,
+                                SendMessageContext{tracking_id, this, msg, props})
+                       .first->second;
+      }
       auto ok = IoTHubDeviceClient_SendEventAsync(client_handle_, message_handle,
-                                                  SendMessageCallback,
-                                                  &messages[tracking_id]);
+                                                  SendMessageCallback, context);
 
       if (ok != IOTHUB_CLIENT_OK)
       {
+        EraseMessage(tracking_id);
         throw IoTHubConnectionRequestException("Could't send request to IoTHub");
       }
     }
@@ -244,6 +351,9 @@ namespace iothub
     }
 
   private:
+    using MessagePtr = std::unique_ptr<std::remove_pointer_t<IOTHUB_MESSAGE_HANDLE>,
+                                       decltype(&IoTHubMessage_Destroy)>;
+
     struct SendMessageContext
     {
       std::size_t tracking_id;
@@ -257,12 +367,28 @@ namespace iothub
     StateCallback state_callback_;
     ConnectionStateCallback connection_state_callback_;
     ErrorCallback error_callback_;
-    std::atomic<std::size_t> tracking_id_count;
+    std::shared_ptr<CallbackExecutor> executor_ =
+        std::make_shared<InlineExecutor>();
+    std::atomic<std::size_t> tracking_id_count{0};
     std::map<std::size_t, SendMessageContext> messages;
+    std::mutex messages_mutex_;
     std::mutex state_mutex_;
     std::mutex state_callback_mutex_;
     std::mutex connection_state_callback_mutex_;
     std::mutex error_callback_mutex_;
+    ReportMode report_mode_ = ReportMode::Full;
+    std::chrono::milliseconds report_debounce_{0};
+    std::chrono::steady_clock::time_point report_deadline_;
+    json reported_baseline_;
+    StateType last_reported_{};
+    StateType pending_report_{};
+    bool has_pending_report_ = false;
+    unsigned report_retries_ = 0;
+    bool report_stop_ = false;
+    std::thread report_thread_;
+    std::condition_variable report_cv_;
+    std::mutex report_mutex_;
+    std::mutex report_send_mutex_;
 
     StateType State()
     {
@@ -276,24 +402,247 @@ namespace iothub
       state_ = state;
     }
 
+    // The callback is copied under its mutex and handed to the executor, so
+    // the SDK thread never runs user code while holding a lock.
     void CallStateCallback(StateType state)
     {
-      std::lock_guard<std::mutex> guard(state_callback_mutex_);
-      state_callback_(state);
+      StateCallback callback;
+      {
+        std::lock_guard<std::mutex> guard(state_callback_mutex_);
+        callback = state_callback_;
+      }
+
+      if (callback)
+      {
+        std::atomic_load(&executor_)->Post(
+            [callback, state]() { callback(state); });
+      }
     }
 
     void CallConnectionStateCallback(
         IOTHUB_CLIENT_CONNECTION_STATUS status,
         IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason)
     {
-      std::lock_guard<std::mutex> guard(connection_state_callback_mutex_);
-      connection_state_callback_(status, reason);
+      ConnectionStateCallback callback;
+      {
+        std::lock_guard<std::mutex> guard(connection_state_callback_mutex_);
+        callback = connection_state_callback_;
+      }
+
+      if (callback)
+      {
+        std::atomic_load(&executor_)->Post(
+            [callback, status, reason]() { callback(status, reason); });
+      }
     }
 
     void CallErrorCallback()
     {
-      std::lock_guard<std::mutex> guard(error_callback_mutex_);
-      error_callback_();
+      ErrorCallback callback;
+      {
+        std::lock_guard<std::mutex> guard(error_callback_mutex_);
+        callback = error_callback_;
+      }
+
+      if (callback)
+      {
+        std::atomic_load(&executor_)->Post(callback);
+      }
+    }
+
+    // Reports are serialized by report_send_mutex_ so patches reach the hub in
+    // the order they were computed. report_mutex_ is never held while calling
+    // into the SDK, as the SDK takes it from its own thread on failures.
+    bool PublishReport(const StateType &state)
+    {
+      std::lock_guard<std::mutex> send_guard(report_send_mutex_);
+      std::string json_str;
+      bool delta;
+
+      {
+        std::lock_guard<std::mutex> guard(report_mutex_);
+        delta = report_mode_ == ReportMode::Delta;
+        if (delta)
+        {
+          json reported = StateToJson(state);
+          if (!reported_baseline_.is_null())
+          {
+            json patch = MergePatch(reported_baseline_, reported);
+            if (patch.empty())
+            {
+              return true;
+            }
+            json_str = patch.dump();
+          }
+          else
+          {
+            json_str = reported.dump();
+          }
+          reported_baseline_ = std::move(reported);
+          last_reported_ = state;
+        }
+        else
+        {
+          reported_baseline_ = json();
+        }
+      }
+
+      // Full reports go out exactly as the converter wrote them
+      if (!delta)
+      {
+        json_str = Converters<StateType>::ToJson(state);
+      }
+
+      const unsigned char *payload =
+          reinterpret_cast<const unsigned char *>(json_str.c_str());
+      auto ok = IoTHubDeviceClient_SendReportedState(
+          client_handle_, payload, json_str.size(), SendReportStateCallback,
+          this);
+
+      if (ok != IOTHUB_CLIENT_OK)
+      {
+        std::lock_guard<std::mutex> guard(report_mutex_);
+        reported_baseline_ = json();
+        return false;
+      }
+
+      return true;
+    }
+
+    // Next report carries the whole state again
+    void ResetReportBaseline()
+    {
+      std::lock_guard<std::mutex> guard(report_mutex_);
+      reported_baseline_ = json();
+    }
+
+    void ReportAccepted()
+    {
+      std::lock_guard<std::mutex> guard(report_mutex_);
+      report_retries_ = 0;
+    }
+
+    // A lost patch leaves the hub behind until the state changes again, so a
+    // full report of the latest state is scheduled from the report thread.
+    void RetryFullReport()
+    {
+      std::lock_guard<std::mutex> guard(report_mutex_);
+      reported_baseline_ = json();
+
+      if (report_mode_ != ReportMode::Delta || report_stop_)
+      {
+        return;
+      }
+
+      // A pending report goes out in full anyway now the baseline is gone
+      if (!has_pending_report_)
+      {
+        auto delay = REPORT_RETRY_DELAY * (1 << std::min(report_retries_, 6u));
+        pending_report_ = last_reported_;
+        report_deadline_ = std::chrono::steady_clock::now() +
+                           std::min(delay, REPORT_RETRY_MAX_DELAY);
+        has_pending_report_ = true;
+        report_retries_++;
+      }
+
+      if (!report_thread_.joinable())
+      {
+        report_thread_ = std::thread(&IoTHubConnection::ReportLoop, this);
+      }
+      report_cv_.notify_all();
+    }
+
+    void ReportLoop()
+    {
+      std::unique_lock<std::mutex> lock(report_mutex_);
+      while (true)
+      {
+        report_cv_.wait(lock,
+                        [this] { return has_pending_report_ || report_stop_; });
+        if (!has_pending_report_)
+        {
+          break;
+        }
+
+        report_cv_.wait_until(lock, report_deadline_,
+                              [this] { return report_stop_; });
+        if (!has_pending_report_)
+        {
+          continue;
+        }
+
+        StateType state = std::move(pending_report_);
+        has_pending_report_ = false;
+
+        lock.unlock();
+        if (!PublishReport(state))
+        {
+          CallErrorCallback();
+          RetryFullReport();
+        }
+        lock.lock();
+      }
+    }
+
+    static json StateToJson(const StateType &state)
+    {
+      if constexpr (Reflection<StateType>::reflected)
+      {
+        json j = json::object();
+        WriteFields(state, j);
+        return j;
+      }
+      else
+      {
+        return json::parse(Converters<StateType>::ToJson(state));
+      }
+    }
+
+    static StateType StateFromJson(const json &j)
+    {
+      if constexpr (Reflection<StateType>::reflected)
+      {
+        StateType state{};
+        ReadFields(j, state);
+        return state;
+      }
+      else
+      {
+        return Converters<StateType>::FromJson(j.dump());
+      }
+    }
+
+    // Applies a twin merge-patch on top of state
+    static void MergeState(const json &patch, StateType &state)
+    {
+      if constexpr (Reflection<StateType>::reflected)
+      {
+        ReadFields(patch, state);
+      }
+      else
+      {
+        json current = StateToJson(state);
+        current.merge_patch(patch);
+        state = Converters<StateType>::FromJson(current.dump());
+      }
+    }
+
+    static bool StateEquals(const StateType &a, const StateType &b)
+    {
+      if constexpr (Reflection<StateType>::reflected)
+      {
+        return FieldsEqual(a, b);
+      }
+      else
+      {
+        return !(a != b);
+      }
+    }
+
+    void EraseMessage(std::size_t tracking_id)
+    {
+      std::lock_guard<std::mutex> guard(messages_mutex_);
+      messages.erase(tracking_id);
     }
 
     void SetProperties(IOTHUB_MESSAGE_HANDLE msg_handle,
@@ -336,9 +685,22 @@ namespace iothub
           reinterpret_cast<IoTHubConnection *>(userContextCallback);
 
       // Assume status code are like HTTP ones
-      if (statusCode < 200 || statusCode >= 400)
+      if (statusCode >= 200 && statusCode < 400)
       {
-        connection->CallErrorCallback();
+        connection->ReportAccepted();
+        return;
+      }
+
+      connection->CallErrorCallback();
+      if (statusCode < 200 || statusCode == 408 || statusCode == 429 ||
+          statusCode >= 500)
+      {
+        connection->RetryFullReport();
+      }
+      else
+      {
+        // The hub won't take this report, retrying it would only fail again
+        connection->ResetReportBaseline();
       }
     }
 
@@ -354,7 +716,6 @@ namespace iothub
         try
         {
           connection->SendMessage(context->msg, context->props);
-          connection->messages.erase(context->tracking_id);
         }
         catch (const std::exception &e)
         {
@@ -365,6 +726,9 @@ namespace iothub
       {
         connection->CallErrorCallback();
       }
+
+      // The SDK is done with this message whatever the result
+      connection->EraseMessage(context->tracking_id);
     }
 
     static void UploadFileCallback(IOTHUB_CLIENT_FILE_UPLOAD_RESULT result,
@@ -403,14 +767,21 @@ namespace iothub
         body = body["desired"];
       }
 
-      json current_state =
-          json::parse(Converters<StateType>::ToJson(connection->State()));
-      current_state.merge_patch(body);
-
-      StateType result = Converters<StateType>::FromJson(current_state.dump());
+      StateType current_state = connection->State();
+      StateType result = current_state;
+      try
+      {
+        MergeState(body, result);
+      }
+      catch (const std::exception &)
+      {
+        // A desired property of the wrong type
+        connection->CallErrorCallback();
+        return;
+      }
 
       // Check if state changed
-      if (result != connection->State())
+      if (!StateEquals(result, current_state))
       {
         connection->CallStateCallback(result);
       }
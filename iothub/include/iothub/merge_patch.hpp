@@ -0,0 +1,43 @@
+#ifndef IOT_HUB_MERGE_PATCH
+#define IOT_HUB_MERGE_PATCH
+
+#include <nlohmann/json.hpp>
+
+namespace iothub
+{
+  // Builds the RFC 7396 merge-patch that turns from into to, so that
+  // from.merge_patch(MergePatch(from, to)) == to. Arrays are replaced whole.
+  inline nlohmann::json MergePatch(const nlohmann::json &from,
+                                   const nlohmann::json &to)
+  {
+    if (!from.is_object() || !to.is_object())
+    {
+      return to;
+    }
+
+    nlohmann::json patch = nlohmann::json::object();
+    for (auto it = to.begin(); it != to.end(); ++it)
+    {
+      auto previous = from.find(it.key());
+      if (previous == from.end())
+      {
+        patch[it.key()] = it.value();
+      }
+      else if (*previous != it.value())
+      {
+        patch[it.key()] = MergePatch(*previous, it.value());
+      }
+    }
+    for (auto it = from.begin(); it != from.end(); ++it)
+    {
+      if (!to.contains(it.key()))
+      {
+        patch[it.key()] = nullptr;
+      }
+    }
+
+    return patch;
+  }
+} // namespace iothub
+
+#endif // !IOT_HUB_MERGE_PATCH
@@ -0,0 +1,319 @@
+#ifndef IOT_HUB_REFLECTION
+#define IOT_HUB_REFLECTION
+
+#include <iterator>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include <nlohmann/json.hpp>
+
+namespace iothub
+{
+  template <typename Class, typename Member>
+  struct Field
+  {
+    using Type = Member;
+
+    const char *name;
+    Member Class::*member;
+  };
+
+  // Specialized by IOTHUB_REFLECT with the list of fields of T
+  template <typename T>
+  struct Reflection
+  {
+    static constexpr bool reflected = false;
+  };
+
+  template <typename T, typename F>
+  void ForEachField(F &&f)
+  {
+    std::apply([&f](auto... fields) { (f(fields), ...); },
+               Reflection<T>::Fields());
+  }
+
+  template <typename T>
+  void WriteFields(const T &value, nlohmann::json &j)
+  {
+    ForEachField<T>([&](auto field) { j[field.name] = value.*field.member; });
+  }
+
+  // Applies j to value with merge-patch semantics: missing properties keep
+  // their current value and null ones are reset to their default. Other
+  // members patched with an object, like maps or json, are merged through
+  // their JSON form, so keys left out of the patch survive and null ones are
+  // removed. Throws nlohmann::json::type_error when j, or the value of a
+  // field, has the wrong type; a described type expects an object.
+  template <typename T>
+  void ReadFields(const nlohmann::json &j, T &value)
+  {
+    const auto &object = j.get_ref<const nlohmann::json::object_t &>();
+
+    ForEachField<T>([&](auto field) {
+      using Member = typename decltype(field)::Type;
+
+      auto it = object.find(field.name);
+      if (it == object.end())
+      {
+        return;
+      }
+
+      Member &member = value.*field.member;
+      if (it->second.is_null())
+      {
+        // Keeps the default member initializer, if any
+        member = T{}.*field.member;
+      }
+      else if constexpr (Reflection<Member>::reflected)
+      {
+        ReadFields(it->second, member);
+      }
+      else if (it->second.is_object())
+      {
+        nlohmann::json current = member;
+        current.merge_patch(it->second);
+        current.get_to(member);
+      }
+      else
+      {
+        it->second.get_to(member);
+      }
+    });
+  }
+
+  template <typename T>
+  bool FieldsEqual(const T &a, const T &b);
+
+  // Whether T holds a described type somewhere, directly or through
+  // containers and pairs, so it can't rely on operator==
+  template <typename T, typename = void>
+  struct HoldsReflected : std::bool_constant<Reflection<T>::reflected>
+  {
+  };
+
+  template <typename First, typename Second>
+  struct HoldsReflected<std::pair<First, Second>>
+      : std::bool_constant<HoldsReflected<std::remove_const_t<First>>::value ||
+                           HoldsReflected<Second>::value>
+  {
+  };
+
+  // Ranges, except those holding themselves like nlohmann::json
+  template <typename T>
+  struct HoldsReflected<
+      T, std::enable_if_t<
+             !std::is_same_v<typename T::value_type, T>,
+             std::void_t<decltype(std::begin(std::declval<const T &>()))>>>
+      : HoldsReflected<typename T::value_type>
+  {
+  };
+
+  template <typename T, typename = void>
+  struct IsMap : std::false_type
+  {
+  };
+
+  template <typename T>
+  struct IsMap<T, std::void_t<typename T::key_type, typename T::mapped_type>>
+      : std::true_type
+  {
+  };
+
+  template <typename T>
+  struct IsPair : std::false_type
+  {
+  };
+
+  template <typename First, typename Second>
+  struct IsPair<std::pair<First, Second>> : std::true_type
+  {
+  };
+
+  template <typename T>
+  bool ValuesEqual(const T &a, const T &b)
+  {
+    if constexpr (Reflection<T>::reflected)
+    {
+      return FieldsEqual(a, b);
+    }
+    else if constexpr (!HoldsReflected<T>::value)
+    {
+      return a == b;
+    }
+    else if constexpr (IsPair<T>::value)
+    {
+      return ValuesEqual(a.first, b.first) && ValuesEqual(a.second, b.second);
+    }
+    else if constexpr (IsMap<T>::value)
+    {
+      // By key, as unordered maps may iterate in different orders
+      if (a.size() != b.size())
+      {
+        return false;
+      }
+      for (const auto &entry : a)
+      {
+        auto other = b.find(entry.first);
+        if (other == b.end() || !ValuesEqual(entry.second, other->second))
+        {
+          return false;
+        }
+      }
+      return true;
+    }
+    else
+    {
+      auto it = std::begin(b), end = std::end(b);
+      for (const auto &element : a)
+      {
+        if (it == end || !ValuesEqual(element, *it))
+        {
+          return false;
+        }
+        ++it;
+      }
+      return it == end;
+    }
+  }
+
+  template <typename T>
+  bool FieldsEqual(const T &a, const T &b)
+  {
+    bool equal = true;
+    ForEachField<T>([&](auto field) {
+      equal = equal && ValuesEqual(a.*field.member, b.*field.member);
+    });
+    return equal;
+  }
+} // namespace iothub
+
+namespace nlohmann
+{
+  template <typename T>
+  struct adl_serializer<T, std::enable_if_t<iothub::Reflection<T>::reflected>>
+  {
+    template <typename BasicJson>
+    static void to_json(BasicJson &j, const T &value)
+    {
+      j = BasicJson::object();
+      iothub::WriteFields(value, j);
+    }
+
+    template <typename BasicJson>
+    static void from_json(const BasicJson &j, T &value)
+    {
+      iothub::ReadFields(j, value);
+    }
+  };
+} // namespace nlohmann
+
+#define IOTHUB_EXPAND(x) x
+#define IOTHUB_FOR_EACH_1(m, t, x) m(t, x)
+#define IOTHUB_FOR_EACH_2(m, t, x, ...) \
+  m(t, x), IOTHUB_EXPAND(IOTHUB_FOR_EACH_1(m, t, __VA_ARGS__))
+#define IOTHUB_FOR_EACH_3(m, t, x, ...) \
+  m(t, x), IOTHUB_EXPAND(IOTHUB_FOR_EACH_2(m, t, __VA_ARGS__))
+#define IOTHUB_FOR_EACH_4(m, t, x, ...) \
+  m(t, x), IOTHUB_EXPAND(IOTHUB_FOR_EACH_3(m, t, __VA_ARGS__))
+#define IOTHUB_FOR_EACH_5(m, t, x, ...) \
+  m(t, x), IOTHUB_EXPAND(IOTHUB_FOR_EACH_4(m, t, __VA_ARGS__))
+#define IOTHUB_FOR_EACH_6(m, t, x, ...) \
+  m(t, x), IOTHUB_EXPAND(IOTHUB_FOR_EACH_5(m, t, __VA_ARGS__))
+#define IOTHUB_FOR_EACH_7(m, t, x, ...) \
+  m(t, x), IOTHUB_EXPAND(IOTHUB_FOR_EACH_6(m, t, __VA_ARGS__))
+#define IOTHUB_FOR_EACH_8(m, t, x, ...) \
+  m(t, x), IOTHUB_EXPAND(IOTHUB_FOR_EACH_7(m, t, __VA_ARGS__))
+#define IOTHUB_FOR_EACH_9(m, t, x, ...) \
+  m(t, x), IOTHUB_EXPAND(IOTHUB_FOR_EACH_8(m, t, __VA_ARGS__))
+#define IOTHUB_FOR_EACH_10(m, t, x, ...) \
+  m(t, x), IOTHUB_EXPAND(IOTHUB_FOR_EACH_9(m, t, __VA_ARGS__))
+#define IOTHUB_FOR_EACH_11(m, t, x, ...) \
+  m(t, x), IOTHUB_EXPAND(IOTHUB_FOR_EACH_10(m, t, __VA_ARGS__))
+#define IOTHUB_FOR_EACH_12(m, t, x, ...) \
+  m(t, x), IOTHUB_EXPAND(IOTHUB_FOR_EACH_11(m, t, __VA_ARGS__))
+#define IOTHUB_FOR_EACH_13(m, t, x, ...) \
+  m(t, x), IOTHUB_EXPAND(IOTHUB_FOR_EACH_12(m, t, __VA_ARGS__))
+#define IOTHUB_FOR_EACH_14(m, t, x, ...) \
+  m(t, x), IOTHUB_EXPAND(IOTHUB_FOR_EACH_13(m, t, __VA_ARGS__))
+#define IOTHUB_FOR_EACH_15(m, t, x, ...) \
+  m(t, x), IOTHUB_EXPAND(IOTHUB_FOR_EACH_14(m, t, __VA_ARGS__))
+#define IOTHUB_FOR_EACH_16(m, t, x, ...) \
+  m(t, x), IOTHUB_EXPAND(IOTHUB_FOR_EACH_15(m, t, __VA_ARGS__))
+#define IOTHUB_FOR_EACH_17(m, t, x, ...) \
+  m(t, x), IOTHUB_EXPAND(IOTHUB_FOR_EACH_16(m, t, __VA_ARGS__))
+#define IOTHUB_FOR_EACH_18(m, t, x, ...) \
+  m(t, x), IOTHUB_EXPAND(IOTHUB_FOR_EACH_17(m, t, __VA_ARGS__))
+#define IOTHUB_FOR_EACH_19(m, t, x, ...) \
+  m(t, x), IOTHUB_EXPAND(IOTHUB_FOR_EACH_18(m, t, __VA_ARGS__))
+#define IOTHUB_FOR_EACH_20(m, t, x, ...) \
+  m(t, x), IOTHUB_EXPAND(IOTHUB_FOR_EACH_19(m, t, __VA_ARGS__))
+#define IOTHUB_FOR_EACH_21(m, t, x, ...) \
+  m(t, x), IOTHUB_EXPAND(IOTHUB_FOR_EACH_20(m, t, __VA_ARGS__))
+#define IOTHUB_FOR_EACH_22(m, t, x, ...) \
+  m(t, x), IOTHUB_EXPAND(IOTHUB_FOR_EACH_21(m, t, __VA_ARGS__))
+#define IOTHUB_FOR_EACH_23(m, t, x, ...) \
+  m(t, x), IOTHUB_EXPAND(IOTHUB_FOR_EACH_22(m, t, __VA_ARGS__))
+#define IOTHUB_FOR_EACH_24(m, t, x, ...) \
+  m(t, x), IOTHUB_EXPAND(IOTHUB_FOR_EACH_23(m, t, __VA_ARGS__))
+#define IOTHUB_FOR_EACH_25(m, t, x, ...) \
+  m(t, x), IOTHUB_EXPAND(IOTHUB_FOR_EACH_24(m, t, __VA_ARGS__))
+#define IOTHUB_FOR_EACH_26(m, t, x, ...) \
+  m(t, x), IOTHUB_EXPAND(IOTHUB_FOR_EACH_25(m, t, __VA_ARGS__))
+#define IOTHUB_FOR_EACH_27(m, t, x, ...) \
+  m(t, x), IOTHUB_EXPAND(IOTHUB_FOR_EACH_26(m, t, __VA_ARGS__))
+#define IOTHUB_FOR_EACH_28(m, t, x, ...) \
+  m(t, x), IOTHUB_EXPAND(IOTHUB_FOR_EACH_27(m, t, __VA_ARGS__))
+#define IOTHUB_FOR_EACH_29(m, t, x, ...) \
+  m(t, x), IOTHUB_EXPAND(IOTHUB_FOR_EACH_28(m, t, __VA_ARGS__))
+#define IOTHUB_FOR_EACH_30(m, t, x, ...) \
+  m(t, x), IOTHUB_EXPAND(IOTHUB_FOR_EACH_29(m, t, __VA_ARGS__))
+#define IOTHUB_FOR_EACH_31(m, t, x, ...) \
+  m(t, x), IOTHUB_EXPAND(IOTHUB_FOR_EACH_30(m, t, __VA_ARGS__))
+#define IOTHUB_FOR_EACH_32(m, t, x, ...) \
+  m(t, x), IOTHUB_EXPAND(IOTHUB_FOR_EACH_31(m, t, __VA_ARGS__))
+#define IOTHUB_FOR_EACH_N(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, \
+  _12, _13, _14, _15, _16, _17, _18, _19, _20, _21, _22, _23, _24, _25, \
+  _26, _27, _28, _29, _30, _31, _32, NAME, ...) NAME
+#define IOTHUB_FOR_EACH(m, t, ...) \
+  IOTHUB_EXPAND(IOTHUB_FOR_EACH_N(__VA_ARGS__, IOTHUB_FOR_EACH_32, \
+                               IOTHUB_FOR_EACH_31, IOTHUB_FOR_EACH_30, \
+                               IOTHUB_FOR_EACH_29, IOTHUB_FOR_EACH_28, \
+                               IOTHUB_FOR_EACH_27, IOTHUB_FOR_EACH_26, \
+                               IOTHUB_FOR_EACH_25, IOTHUB_FOR_EACH_24, \
+                               IOTHUB_FOR_EACH_23, IOTHUB_FOR_EACH_22, \
+                               IOTHUB_FOR_EACH_21, IOTHUB_FOR_EACH_20, \
+                               IOTHUB_FOR_EACH_19, IOTHUB_FOR_EACH_18, \
+                               IOTHUB_FOR_EACH_17, IOTHUB_FOR_EACH_16, \
+                               IOTHUB_FOR_EACH_15, IOTHUB_FOR_EACH_14, \
+                               IOTHUB_FOR_EACH_13, IOTHUB_FOR_EACH_12, \
+                               IOTHUB_FOR_EACH_11, IOTHUB_FOR_EACH_10, \
+                               IOTHUB_FOR_EACH_9, IOTHUB_FOR_EACH_8, \
+                               IOTHUB_FOR_EACH_7, IOTHUB_FOR_EACH_6, \
+                               IOTHUB_FOR_EACH_5, IOTHUB_FOR_EACH_4, \
+                               IOTHUB_FOR_EACH_3, IOTHUB_FOR_EACH_2, \
+                               IOTHUB_FOR_EACH_1)(m, t, __VA_ARGS__))
+
+#define IOTHUB_FIELD(Type, field) \
+  ::iothub::Field<Type, decltype(Type::field)> { #field, &Type::field }
+
+// Describes the fields of Type, which then gets JSON converters and
+// field-wise equality. Must be used at global scope:
+//   IOTHUB_REFLECT(my::State, temperature, fan_speed, enabled)
+#define IOTHUB_REFLECT(Type, ...)                                        \
+  namespace iothub                                                       \
+  {                                                                      \
+    template <>                                                          \
+    struct Reflection<Type>                                              \
+    {                                                                    \
+      static constexpr bool reflected = true;                            \
+                                                                         \
+      static constexpr auto Fields()                                     \
+      {                                                                  \
+        return std::make_tuple(IOTHUB_FOR_EACH(IOTHUB_FIELD, Type,       \
+                                               __VA_ARGS__));            \
+      }                                                                  \
+    };                                                                   \
+  }
+
+#endif // !IOT_HUB_REFLECTION
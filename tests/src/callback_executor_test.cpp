@@ -0,0 +1,170 @@
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <iothub/callback_executor.hpp>
+
+using iothub::CallbackExecutor;
+using iothub::ThreadExecutor;
+using iothub::ThreadPoolExecutor;
+
+TEST_CASE("A strand runs its callbacks in posting order",
+          "[iothub][callback_executor]")
+{
+  const int count = 10000;
+  std::vector<int> order;
+  {
+    ThreadPoolExecutor pool(4);
+    auto strand = pool.MakeStrand();
+    for (int i = 0; i < count; i++)
+    {
+      // No lock, the strand never runs two callbacks at once
+      strand->Post([&order, i]() { order.push_back(i); });
+    }
+  }
+
+  REQUIRE(order.size() == count);
+  for (int i = 0; i < count; i++)
+  {
+    REQUIRE(order[i] == i);
+  }
+}
+
+TEST_CASE("Strands keep each producer's order and never overlap",
+          "[iothub][callback_executor]")
+{
+  const int strands = 8, producers = 4, per_producer = 2000;
+
+  struct Log
+  {
+    std::vector<std::vector<int>> by_producer{producers};
+    std::atomic<int> running{0};
+    bool overlapped = false;
+  };
+  std::vector<Log> logs(strands);
+
+  {
+    ThreadPoolExecutor pool(4);
+    std::vector<std::shared_ptr<CallbackExecutor>> executors;
+    for (int s = 0; s < strands; s++)
+    {
+      executors.push_back(pool.MakeStrand());
+    }
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++)
+    {
+      threads.emplace_back([&, p]() {
+        for (int i = 0; i < per_producer; i++)
+        {
+          int s = (i + p) % strands;
+          Log &log = logs[s];
+          executors[s]->Post([&log, p, i]() {
+            log.overlapped |= log.running.fetch_add(1) != 0;
+            log.by_producer[p].push_back(i);
+            log.running.fetch_sub(1);
+          });
+        }
+      });
+    }
+    for (auto &t : threads)
+    {
+      t.join();
+    }
+  }
+
+  std::size_t total = 0;
+  for (const auto &log : logs)
+  {
+    REQUIRE_FALSE(log.overlapped);
+    for (const auto &sequence : log.by_producer)
+    {
+      REQUIRE(std::is_sorted(sequence.begin(), sequence.end()));
+      total += sequence.size();
+    }
+  }
+  REQUIRE(total == producers * per_producer);
+}
+
+TEST_CASE("A busy strand doesn't hold back the others",
+          "[iothub][callback_executor]")
+{
+  ThreadPoolExecutor pool(2);
+  auto slow = pool.MakeStrand();
+  auto fast = pool.MakeStrand();
+
+  std::promise<void> release;
+  std::shared_future<void> released = release.get_future().share();
+  std::atomic<bool> slow_done{false};
+  slow->Post([released, &slow_done]() {
+    released.wait();
+    slow_done = true;
+  });
+
+  std::promise<void> fast_ran;
+  fast->Post([&fast_ran]() { fast_ran.set_value(); });
+
+  REQUIRE(fast_ran.get_future().wait_for(std::chrono::seconds(5)) ==
+          std::future_status::ready);
+  REQUIRE_FALSE(slow_done);
+  release.set_value();
+}
+
+TEST_CASE("Destroying an executor runs what is still queued",
+          "[iothub][callback_executor]")
+{
+  const int count = 1000;
+  std::atomic<int> ran{0};
+
+  SECTION("ThreadPoolExecutor")
+  {
+    {
+      ThreadPoolExecutor pool(2);
+      auto first = pool.MakeStrand();
+      auto second = pool.MakeStrand();
+      for (int i = 0; i < count; i++)
+      {
+        (i % 2 ? first : second)->Post([&ran]() {
+          std::this_thread::yield();
+          ran++;
+        });
+      }
+    }
+    REQUIRE(ran == count);
+  }
+
+  SECTION("ThreadExecutor")
+  {
+    {
+      ThreadExecutor executor;
+      for (int i = 0; i < count; i++)
+      {
+        executor.Post([&ran]() {
+          std::this_thread::yield();
+          ran++;
+        });
+      }
+    }
+    REQUIRE(ran == count);
+  }
+}
+
+TEST_CASE("A throwing callback doesn't stop its strand",
+          "[iothub][callback_executor]")
+{
+  std::atomic<int> ran{0};
+  {
+    ThreadPoolExecutor pool(1);
+    auto strand = pool.MakeStrand();
+    strand->Post([]() { throw std::runtime_error("callback"); });
+    strand->Post([&ran]() { ran++; });
+  }
+  REQUIRE(ran == 1);
+}
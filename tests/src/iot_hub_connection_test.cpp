@@ -0,0 +1,166 @@
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <iothub/iot_hub_connection.hpp>
+#include <mock_hub.hpp>
+
+using nlohmann::json;
+
+namespace
+{
+  struct Fan
+  {
+    int level = 1;
+    std::string label;
+  };
+
+  struct State
+  {
+    double temperature = 20;
+    bool enabled = false;
+    Fan fan;
+  };
+} // namespace
+
+IOTHUB_REFLECT(Fan, level, label)
+IOTHUB_REFLECT(State, temperature, enabled, fan)
+
+namespace
+{
+  using Connection = iothub::IoTHubConnection<State>;
+
+  const char *CONNECTION_STRING =
+      "HostName=localhost;DeviceId=test;SharedAccessKey=a2V5";
+
+  std::unique_ptr<Connection> Connect()
+  {
+    mock_hub::Config config;
+    config.latency = std::chrono::milliseconds(1);
+    config.record_reports = true;
+    mock_hub::Configure(config);
+
+    return std::make_unique<Connection>(CONNECTION_STRING);
+  }
+
+  std::size_t ReportCount()
+  {
+    return mock_hub::Collect().reported_states.size();
+  }
+
+  // The reports sent after the first from ones, once there are count of them
+  std::vector<json> WaitForReports(std::size_t from, std::size_t count)
+  {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    std::vector<std::string> reports = mock_hub::Collect().reported_states;
+    while (reports.size() < from + count &&
+           std::chrono::steady_clock::now() < deadline)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      reports = mock_hub::Collect().reported_states;
+    }
+
+    std::vector<json> sent;
+    for (std::size_t i = from; i < reports.size(); i++)
+    {
+      sent.push_back(json::parse(reports[i]));
+    }
+    return sent;
+  }
+
+  State Sample()
+  {
+    State state;
+    state.temperature = 18;
+    state.enabled = true;
+    state.fan = {3, "fan"};
+    return state;
+  }
+} // namespace
+
+TEST_CASE("Delta reports carry only the changed fields",
+          "[iothub][iot_hub_connection]")
+{
+  auto connection = Connect();
+  connection->SetReportMode(Connection::ReportMode::Delta);
+  std::size_t from = ReportCount();
+
+  State state = Sample();
+  connection->SendReportState(state);
+  state.temperature = 19;
+  state.fan.label = "renamed";
+  connection->SendReportState(state);
+  // Nothing changed, nothing to send
+  connection->SendReportState(state);
+
+  std::vector<json> sent = WaitForReports(from, 2);
+  REQUIRE(sent.size() == 2);
+  REQUIRE(sent[0] == json(Sample()));
+  REQUIRE(sent[1] ==
+          json{{"temperature", 19}, {"fan", {{"label", "renamed"}}}});
+}
+
+TEST_CASE("Debounced reports are coalesced into the latest state",
+          "[iothub][iot_hub_connection]")
+{
+  auto connection = Connect();
+  connection->SetReportMode(Connection::ReportMode::Delta,
+                            std::chrono::milliseconds(200));
+  std::size_t from = ReportCount();
+
+  State state = Sample();
+  for (int i = 0; i < 5; i++)
+  {
+    state.fan.level = i;
+    connection->SendReportState(state);
+  }
+
+  std::vector<json> sent = WaitForReports(from, 1);
+  std::this_thread::sleep_for(std::chrono::milliseconds(400));
+
+  REQUIRE(ReportCount() == from + 1);
+  REQUIRE(sent.size() == 1);
+  REQUIRE(sent[0] == json(state));
+}
+
+TEST_CASE("A report answered with 500 is sent again in full",
+          "[iothub][iot_hub_connection]")
+{
+  auto connection = Connect();
+  connection->SetReportMode(Connection::ReportMode::Delta);
+  std::size_t from = ReportCount();
+
+  State state = Sample();
+  connection->SendReportState(state);
+  WaitForReports(from, 1);
+
+  mock_hub::FailReports(1);
+  state.enabled = false;
+  connection->SendReportState(state);
+
+  std::vector<json> sent = WaitForReports(from, 3);
+  REQUIRE(sent.size() == 3);
+  REQUIRE(sent[1] == json{{"enabled", false}});
+  REQUIRE(sent[2] == json(state));
+}
+
+TEST_CASE("Destroying the connection sends the pending report",
+          "[iothub][iot_hub_connection]")
+{
+  auto connection = Connect();
+  connection->SetReportMode(Connection::ReportMode::Delta,
+                            std::chrono::seconds(60));
+  std::size_t from = ReportCount();
+
+  connection->SendReportState(Sample());
+  REQUIRE(ReportCount() == from);
+  connection.reset();
+
+  std::vector<std::string> reports = mock_hub::Collect().reported_states;
+  REQUIRE(reports.size() == from + 1);
+  REQUIRE(json::parse(reports.back()) == json(Sample()));
+}
@@ -0,0 +1,43 @@
+#include <catch2/catch.hpp>
+
+#include <iothub/merge_patch.hpp>
+
+using nlohmann::json;
+
+TEST_CASE("MergePatch of equal documents is empty", "[iothub][merge_patch]")
+{
+  json state = {{"a", 1}, {"b", {{"c", "x"}}}};
+
+  REQUIRE(iothub::MergePatch(state, state) == json::object());
+}
+
+TEST_CASE("MergePatch carries only what changed", "[iothub][merge_patch]")
+{
+  json from = {{"a", 1}, {"b", {{"c", "x"}, {"d", true}}}, {"e", 2}};
+  json to = {{"a", 1}, {"b", {{"c", "y"}, {"d", true}}}, {"f", 3}};
+
+  json patch = iothub::MergePatch(from, to);
+
+  REQUIRE(patch == json{{"b", {{"c", "y"}}}, {"e", nullptr}, {"f", 3}});
+}
+
+TEST_CASE("MergePatch replaces arrays and non-objects whole",
+          "[iothub][merge_patch]")
+{
+  REQUIRE(iothub::MergePatch({{"a", {1, 2}}}, {{"a", {1, 3}}}) ==
+          json{{"a", {1, 3}}});
+  REQUIRE(iothub::MergePatch({{"a", {{"b", 1}}}}, {{"a", 5}}) ==
+          json{{"a", 5}});
+  REQUIRE(iothub::MergePatch(json(), {{"a", 1}}) == json{{"a", 1}});
+}
+
+TEST_CASE("Applying MergePatch gives the target back", "[iothub][merge_patch]")
+{
+  json from = {{"a", 1}, {"b", {{"c", "x"}, {"d", {1, 2}}}}, {"e", nullptr}};
+  json to = {{"b", {{"d", {3}}, {"g", {{"h", 1.5}}}}}, {"e", 2}};
+
+  json result = from;
+  result.merge_patch(iothub::MergePatch(from, to));
+
+  REQUIRE(result == to);
+}
@@ -0,0 +1,202 @@
+#include <catch2/catch.hpp>
+
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <iothub/reflection.hpp>
+
+using nlohmann::json;
+
+namespace
+{
+  struct Inner
+  {
+    int level = 3;
+    std::string label;
+  };
+
+  struct State
+  {
+    double temperature = 21.5;
+    bool enabled = false;
+    Inner fan;
+    std::vector<Inner> zones;
+    std::map<std::string, Inner> rooms;
+    std::map<std::string, int> limits;
+    std::unordered_map<std::string, Inner> sensors;
+    std::pair<int, Inner> tagged;
+    std::vector<int> codes;
+    json extra;
+  };
+} // namespace
+
+IOTHUB_REFLECT(Inner, level, label)
+IOTHUB_REFLECT(State, temperature, enabled, fan, zones, rooms, limits, sensors,
+               tagged, codes, extra)
+
+namespace
+{
+  State Sample()
+  {
+    State state;
+    state.temperature = 18;
+    state.enabled = true;
+    state.fan = {5, "fan"};
+    state.zones = {{1, "a"}, {2, "b"}};
+    state.rooms = {{"kitchen", {4, "k"}}};
+    state.limits = {{"a", 1}};
+    state.sensors = {{"s1", {6, "x"}}, {"s2", {7, "y"}}};
+    state.tagged = {9, {8, "t"}};
+    state.codes = {1, 2, 3};
+    state.extra = {{"note", "hi"}};
+    return state;
+  }
+} // namespace
+
+TEST_CASE("Described types round-trip through JSON", "[iothub][reflection]")
+{
+  State state = Sample();
+
+  json j = state;
+  REQUIRE(j["fan"] == json{{"level", 5}, {"label", "fan"}});
+  REQUIRE(j["zones"][1]["label"] == "b");
+  REQUIRE(j["rooms"]["kitchen"]["level"] == 4);
+
+  State back = j.get<State>();
+  REQUIRE(iothub::FieldsEqual(back, state));
+  REQUIRE(json(back) == j);
+}
+
+TEST_CASE("ReadFields merges like a twin patch", "[iothub][reflection]")
+{
+  State state = Sample();
+
+  iothub::ReadFields({{"fan", {{"label", "renamed"}}}, {"enabled", false}},
+                     state);
+
+  REQUIRE(state.fan.level == 5);
+  REQUIRE(state.fan.label == "renamed");
+  REQUIRE_FALSE(state.enabled);
+  REQUIRE(state.temperature == 18);
+  REQUIRE(state.zones.size() == 2);
+}
+
+TEST_CASE("Maps and json members merge with the patch",
+          "[iothub][reflection]")
+{
+  State state = Sample();
+
+  iothub::ReadFields({{"limits", {{"b", 5}}},
+                      {"extra", {{"y", 3}}},
+                      {"rooms", {{"kitchen", {{"label", "new"}}}}}},
+                     state);
+
+  REQUIRE(state.limits == std::map<std::string, int>{{"a", 1}, {"b", 5}});
+  REQUIRE(state.extra == json{{"note", "hi"}, {"y", 3}});
+  REQUIRE(state.rooms.at("kitchen").level == 4);
+  REQUIRE(state.rooms.at("kitchen").label == "new");
+}
+
+TEST_CASE("Null removes keys from maps and json members",
+          "[iothub][reflection]")
+{
+  State state = Sample();
+  state.limits["b"] = 5;
+
+  iothub::ReadFields({{"limits", {{"a", nullptr}}},
+                      {"extra", {{"note", nullptr}}},
+                      {"rooms", {{"kitchen", nullptr}}}},
+                     state);
+
+  REQUIRE(state.limits == std::map<std::string, int>{{"b", 5}});
+  REQUIRE(state.extra == json::object());
+  REQUIRE(state.rooms.empty());
+}
+
+TEST_CASE("Null resets a field to its member initializer",
+          "[iothub][reflection]")
+{
+  State state = Sample();
+
+  iothub::ReadFields({{"temperature", nullptr},
+                      {"fan", {{"level", nullptr}}},
+                      {"zones", nullptr}},
+                     state);
+
+  REQUIRE(state.temperature == 21.5);
+  REQUIRE(state.fan.level == 3);
+  REQUIRE(state.fan.label == "fan");
+  REQUIRE(state.zones.empty());
+}
+
+TEST_CASE("Mistyped patches throw", "[iothub][reflection]")
+{
+  State state = Sample();
+
+  REQUIRE_THROWS_AS(iothub::ReadFields({{"temperature", "hot"}}, state),
+                    json::type_error);
+  REQUIRE_THROWS_AS(iothub::ReadFields({{"fan", 5}}, state), json::type_error);
+  REQUIRE_THROWS_AS(iothub::ReadFields({{"fan", {1, 2}}}, state),
+                    json::type_error);
+  REQUIRE_THROWS_AS(iothub::ReadFields(json("state"), state), json::type_error);
+}
+
+TEST_CASE("FieldsEqual compares nested and contained described types",
+          "[iothub][reflection]")
+{
+  State a = Sample(), b = Sample();
+  REQUIRE(iothub::FieldsEqual(a, b));
+
+  SECTION("nested")
+  {
+    b.fan.label = "other";
+    REQUIRE_FALSE(iothub::FieldsEqual(a, b));
+  }
+  SECTION("vector element")
+  {
+    b.zones[1].level = 0;
+    REQUIRE_FALSE(iothub::FieldsEqual(a, b));
+  }
+  SECTION("vector size")
+  {
+    b.zones.push_back({});
+    REQUIRE_FALSE(iothub::FieldsEqual(a, b));
+    REQUIRE_FALSE(iothub::FieldsEqual(b, a));
+  }
+  SECTION("map value")
+  {
+    b.rooms["kitchen"].label = "other";
+    REQUIRE_FALSE(iothub::FieldsEqual(a, b));
+  }
+  SECTION("map key")
+  {
+    b.rooms = {{"hall", a.rooms["kitchen"]}};
+    REQUIRE_FALSE(iothub::FieldsEqual(a, b));
+  }
+  SECTION("unordered map in another order")
+  {
+    b.sensors.clear();
+    b.sensors.rehash(64);
+    b.sensors.emplace("s2", a.sensors["s2"]);
+    b.sensors.emplace("s1", a.sensors["s1"]);
+    REQUIRE(iothub::FieldsEqual(a, b));
+  }
+  SECTION("pair")
+  {
+    b.tagged.second.level = 0;
+    REQUIRE_FALSE(iothub::FieldsEqual(a, b));
+  }
+  SECTION("plain members")
+  {
+    b.codes.push_back(4);
+    REQUIRE_FALSE(iothub::FieldsEqual(a, b));
+  }
+  SECTION("json")
+  {
+    b.extra["note"] = "bye";
+    REQUIRE_FALSE(iothub::FieldsEqual(a, b));
+  }
+}
@@ -4,7 +4,9 @@
 #include <functional>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <sstream>
+#include <stdexcept>
 #include <vector>
 
 #include <curl/curl.h>
@@ -25,9 +25,6 @@ void ftp_curl::send_file(const std::string &file_name, const byte_buffer &buffer
     curl_easy_setopt(this->curl_wrapper_.get(), CURLOPT_LOW_SPEED_TIME, 60L);  // timeout period
     curl_easy_setopt(this->curl_wrapper_.get(), CURLOPT_LOW_SPEED_LIMIT, 30L); // number of bytes during timeout period
 
-    // TODO: Remoev
-    curl_easy_setopt(this->curl_wrapper_.get(), CURLOPT_VERBOSE, 1L); // number of bytes during timeout period
-
     res = curl_easy_perform(this->curl_wrapper_.get());
     if (res != CURLE_OK)
     {